@@ -0,0 +1,188 @@
+/*
+ * Benchmarks of statement tables against the equivalent SQL written inline, to measure what the vtab costs.
+ * Built with statement_vtab.c compiled into the same program, see the bench target of the Makefile.
+ * In the interest of compatibility with SQLite's own license (or rather lack thereof),
+ * the author disclaims copyright to this source code.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+#include "sqlite3.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+int sqlite3_statementvtab_init(sqlite3* db, char** pzErrMsg, const sqlite3_api_routines* pApi);
+
+// allocations are counted by wrapping sqlite's own allocator
+static sqlite3_mem_methods default_mem;
+static sqlite3_int64 num_allocs;
+
+static void* counting_malloc(int n) {
+	num_allocs++;
+	return default_mem.xMalloc(n);
+}
+
+static void* counting_realloc(void* p, int n) {
+	num_allocs++;
+	return default_mem.xRealloc(p,n);
+}
+
+static int install_counting_malloc(void) {
+	sqlite3_mem_methods mem;
+	int ret;
+	if((ret = sqlite3_config(SQLITE_CONFIG_GETMALLOC,&default_mem)) != SQLITE_OK)
+		return ret;
+	mem = default_mem;
+	mem.xMalloc = counting_malloc;
+	mem.xRealloc = counting_realloc;
+	return sqlite3_config(SQLITE_CONFIG_MALLOC,&mem);
+}
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct scenario {
+	const char* name;
+	const char* setup; // run once, as a printf format given the number of rows
+	const char* vtab;  // query on statement tables
+	const char* inline_sql; // the same query written out without them
+};
+
+// outer rows driving the correlated joins are kept in o, the rows looked up in t
+static const struct scenario scenarios[] = {
+	{
+		"table-valued function join",
+		"CREATE TABLE t(a INTEGER PRIMARY KEY, b INT);"
+		"WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM c WHERE x < %d) INSERT INTO t SELECT x, x*3 FROM c;"
+		"CREATE TABLE o(x INT); INSERT INTO o SELECT a FROM t;"
+		"CREATE VIRTUAL TABLE f USING statement((SELECT b*2 AS d FROM t WHERE a = :a));",
+		"SELECT o.x, f.d FROM o, f(o.x)",
+		"SELECT o.x, t.b*2 FROM o JOIN t ON t.a = o.x",
+	},
+	{
+		"IN list",
+		"CREATE TABLE t(a INTEGER PRIMARY KEY, b INT);"
+		"WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM c WHERE x < %d) INSERT INTO t SELECT x, x*3 FROM c;"
+		"CREATE TABLE ids(x INT); INSERT INTO ids SELECT a FROM t WHERE a %% 2 = 0;"
+		"CREATE VIRTUAL TABLE f USING statement((SELECT b*2 AS d FROM t WHERE a = :a));",
+		"SELECT d FROM f WHERE a IN (SELECT x FROM ids)",
+		"SELECT b*2 FROM t WHERE a IN (SELECT x FROM ids)",
+	},
+	{
+		"sparse named parameters",
+		"CREATE TABLE t(a INTEGER PRIMARY KEY, b INT);"
+		"WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM c WHERE x < %d) INSERT INTO t SELECT x, x*3 FROM c;"
+		"CREATE TABLE o(x INT); INSERT INTO o SELECT a FROM t WHERE a %% 4 = 0;"
+		"CREATE VIRTUAL TABLE s USING statement((SELECT b FROM t WHERE a >= :lo AND (:step IS NULL OR a %% :step = 0) AND a < :hi));",
+		"SELECT s.b FROM o, s WHERE s.lo = o.x AND s.hi = o.x + 4",
+		"SELECT t.b FROM o JOIN t ON t.a >= o.x AND t.a < o.x + 4",
+	},
+	{
+		"wide output",
+		"CREATE TABLE t(a INTEGER PRIMARY KEY, s TEXT);"
+		"WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM c WHERE x < %d) INSERT INTO t SELECT x, 'row ' || x FROM c;"
+		"CREATE VIRTUAL TABLE w USING statement((SELECT a, a+1, a+2, a+3, a+4, a+5, a+6, a+7, s, s||1, s||2, s||3, s||4, s||5, s||6, s||7,"
+		" a*1.5, a*2.5, a*3.5, a*4.5, a*5.5, a*6.5, a*7.5, a*8.5, upper(s), lower(s), length(s), a%%2, a%%3, a%%5, a%%7, a%%11 FROM t));",
+		"SELECT * FROM w",
+		"SELECT a, a+1, a+2, a+3, a+4, a+5, a+6, a+7, s, s||1, s||2, s||3, s||4, s||5, s||6, s||7,"
+		" a*1.5, a*2.5, a*3.5, a*4.5, a*5.5, a*6.5, a*7.5, a*8.5, upper(s), lower(s), length(s), a%2, a%3, a%5, a%7, a%11 FROM t",
+	},
+	{
+		"large blob output",
+		"CREATE TABLE t(a INTEGER PRIMARY KEY, data BLOB);"
+		"WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM c WHERE x < max(%d/100,1)) INSERT INTO t SELECT x, randomblob(65536) FROM c;"
+		"CREATE VIRTUAL TABLE l USING statement((SELECT a, data FROM t WHERE a > :after));",
+		"SELECT * FROM l(0)",
+		"SELECT a, data FROM t WHERE a > 0",
+	},
+};
+
+struct result {
+	sqlite3_int64 rows;
+	sqlite3_int64 allocs;
+	double seconds;
+};
+
+// runs the query until at least min_seconds have passed, reading every value of every row
+static int run(sqlite3* db, const char* sql, double min_seconds, struct result* result) {
+	sqlite3_stmt* stmt;
+	int ret;
+	if((ret = sqlite3_prepare_v2(db,sql,-1,&stmt,NULL)) != SQLITE_OK)
+		return ret;
+	memset(result,0,sizeof(*result));
+	sqlite3_int64 allocs = num_allocs;
+	double start = now();
+	do {
+		while((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+			for(int i = 0; i < sqlite3_column_count(stmt); i++)
+				switch(sqlite3_column_type(stmt,i)) {
+				case SQLITE_TEXT:
+				case SQLITE_BLOB:
+					sqlite3_column_blob(stmt,i);
+					sqlite3_column_bytes(stmt,i);
+					break;
+				default:
+					sqlite3_column_int64(stmt,i);
+				}
+			result->rows++;
+		}
+		sqlite3_reset(stmt);
+		if(ret != SQLITE_DONE)
+			break;
+		ret = SQLITE_OK;
+	} while((result->seconds = now()-start) < min_seconds);
+	result->allocs = num_allocs-allocs;
+	sqlite3_finalize(stmt);
+	return ret;
+}
+
+static void report(const char* what, const struct result* result) {
+	printf("  %-8s %12.0f rows/s %8.2f allocs/row\n",what,result->rows/result->seconds,
+		result->rows ? (double)result->allocs/result->rows : 0.0);
+}
+
+int main(int argc, char** argv) {
+	int num_rows = argc > 1 ? atoi(argv[1]) : 10000;
+	double min_seconds = argc > 2 ? atof(argv[2]) : 1;
+	int ret;
+	if(num_rows <= 0 || min_seconds <= 0) {
+		fprintf(stderr,"usage: %s [rows] [seconds]\n",argv[0]);
+		return 2;
+	}
+	if((ret = install_counting_malloc()) != SQLITE_OK || (ret = sqlite3_initialize()) != SQLITE_OK) {
+		fprintf(stderr,"failed to initialize sqlite: %s\n",sqlite3_errstr(ret));
+		return 1;
+	}
+	printf("sqlite %s, %d rows, %g s per query\n",sqlite3_libversion(),num_rows,min_seconds);
+
+	for(size_t i = 0; i < sizeof(scenarios)/sizeof(*scenarios); i++) {
+		const struct scenario* scenario = &scenarios[i];
+		sqlite3* db = NULL;
+		char* setup = sqlite3_mprintf(scenario->setup,num_rows);
+		char* err = NULL;
+		struct result vtab, inline_sql;
+		if(!setup || (ret = sqlite3_open(":memory:",&db)) != SQLITE_OK
+			|| (ret = sqlite3_statementvtab_init(db,&err,NULL)) != SQLITE_OK
+			|| (ret = sqlite3_exec(db,setup,NULL,NULL,&err)) != SQLITE_OK
+			|| (ret = run(db,scenario->vtab,min_seconds,&vtab)) != SQLITE_OK
+			|| (ret = run(db,scenario->inline_sql,min_seconds,&inline_sql)) != SQLITE_OK) {
+			fprintf(stderr,"%s: %s\n",scenario->name,err ? err : db ? sqlite3_errmsg(db) : sqlite3_errstr(ret));
+			sqlite3_free(err);
+			sqlite3_free(setup);
+			sqlite3_close(db);
+			return 1;
+		}
+		printf("%s\n",scenario->name);
+		report("vtab",&vtab);
+		report("inline",&inline_sql);
+		printf("  %-8s %12.2fx\n","overhead",(inline_sql.rows/inline_sql.seconds)/(vtab.rows/vtab.seconds));
+		sqlite3_free(setup);
+		sqlite3_close(db);
+	}
+	return 0;
+}
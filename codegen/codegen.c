@@ -0,0 +1,443 @@
+/*
+ * Compiles statement tables into an extension of their own, with a module for each table specialized to its statement.
+ * Built with statement_vtab.c compiled into the same program, see the codegen target of the Makefile.
+ * In the interest of compatibility with SQLite's own license (or rather lack thereof),
+ * the author disclaims copyright to this source code.
+ */
+
+#include "sqlite3.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int sqlite3_statementvtab_init(sqlite3* db, char** pzErrMsg, const sqlite3_api_routines* pApi);
+
+// what statement_vtab derived for a table when it was created, as kept in its shadow table
+struct table {
+	char* name;
+	char* ident; // the name made into a C identifier, prefixing everything generated for the table
+	char* sql;
+	char* declaration;
+	int num_outputs;
+	int num_inputs;
+	double cost;
+	sqlite3_int64 rows;
+	int unique;
+	char* ordering; // "column desc,..."
+};
+
+// the code generated for each table, with @N@ replaced by its identifier, @C@ by its number of output columns
+// and @P@ by its number of parameters. idxNum has a bit for each parameter bound, whose values sqlite passes to
+// xFilter in the order of the parameters, so no map is needed in idxStr
+static const char table_template[] =
+	"struct @N@_vtab {\n"
+	"\tsqlite3_vtab base;\n"
+	"\tsqlite3* db;\n"
+	"\tsqlite3_stmt* idle; // kept for the next cursor\n"
+	"};\n"
+	"\n"
+	"struct @N@_cursor {\n"
+	"\tsqlite3_vtab_cursor base;\n"
+	"\tsqlite3_stmt* stmt;\n"
+	"\tsqlite3_int64 rowid;\n"
+	"\tint done;\n"
+	"\tsqlite3_value* params[@P@+1]; // bound to each parameter, for the hidden columns\n"
+	"};\n"
+	"\n"
+	"static int @N@_connect(sqlite3* db, void* pAux, int argc, const char* const* argv, sqlite3_vtab** ppVtab, char** pzErr) {\n"
+	"\tstruct @N@_vtab* vtab;\n"
+	"\tint ret = sqlite3_declare_vtab(db,@N@_declaration);\n"
+	"\t(void)pAux, (void)argc, (void)argv, (void)pzErr;\n"
+	"\tif(ret != SQLITE_OK)\n"
+	"\t\treturn ret;\n"
+	"\tif(!(vtab = sqlite3_malloc(sizeof(*vtab))))\n"
+	"\t\treturn SQLITE_NOMEM;\n"
+	"\tmemset(vtab,0,sizeof(*vtab));\n"
+	"\tvtab->db = db;\n"
+	"\t*ppVtab = &vtab->base;\n"
+	"\treturn SQLITE_OK;\n"
+	"}\n"
+	"\n"
+	"static int @N@_disconnect(sqlite3_vtab* pVTab) {\n"
+	"\tsqlite3_finalize(((struct @N@_vtab*)pVTab)->idle);\n"
+	"\tsqlite3_free(pVTab);\n"
+	"\treturn SQLITE_OK;\n"
+	"}\n"
+	"\n"
+	"static int @N@_best_index(sqlite3_vtab* pVTab, sqlite3_index_info* index_info) {\n"
+	"\tunsigned mask = 0, pending;\n"
+	"\tint i;\n"
+	"\t(void)pVTab;\n"
+	"\tfor(i = 0; i < index_info->nConstraint; i++) {\n"
+	"\t\tint param = index_info->aConstraint[i].iColumn-@C@;\n"
+	"\t\tif(param < 0 || param >= @P@)\n"
+	"\t\t\tcontinue;\n"
+	"\t\tif(!index_info->aConstraint[i].usable || index_info->aConstraint[i].op != SQLITE_INDEX_CONSTRAINT_EQ)\n"
+	"\t\t\treturn SQLITE_CONSTRAINT;\n"
+	"\t\tmask |= 1u << param;\n"
+	"\t}\n"
+	"\t// one constraint per parameter is bound, any others are checked by sqlite\n"
+	"\tpending = mask;\n"
+	"\tfor(i = 0; i < index_info->nConstraint; i++) {\n"
+	"\t\tint param = index_info->aConstraint[i].iColumn-@C@;\n"
+	"\t\tif(param < 0 || param >= @P@ || !(pending & (1u << param)))\n"
+	"\t\t\tcontinue;\n"
+	"\t\tindex_info->aConstraintUsage[i].argvIndex = popcount(mask & ((1u << param)-1))+1;\n"
+	"\t\tindex_info->aConstraintUsage[i].omit = 1;\n"
+	"\t\tpending &= ~(1u << param);\n"
+	"\t}\n"
+	"\tindex_info->idxNum = (int)mask;\n"
+	"\tindex_info->estimatedCost = @N@_COST;\n"
+	"\tindex_info->estimatedRows = @N@_ROWS;\n"
+	"\tif(@N@_UNIQUE)\n"
+	"\t\tindex_info->idxFlags |= SQLITE_INDEX_SCAN_UNIQUE;\n"
+	"\tif(index_info->nOrderBy > @N@_ORDER_LEN)\n"
+	"\t\treturn SQLITE_OK;\n"
+	"\tfor(i = 0; i < index_info->nOrderBy; i++)\n"
+	"\t\tif(index_info->aOrderBy[i].iColumn != @N@_order[i][0] || index_info->aOrderBy[i].desc != @N@_order[i][1])\n"
+	"\t\t\treturn SQLITE_OK;\n"
+	"\tindex_info->orderByConsumed = 1;\n"
+	"\treturn SQLITE_OK;\n"
+	"}\n"
+	"\n"
+	"static int @N@_open(sqlite3_vtab* pVTab, sqlite3_vtab_cursor** ppCursor) {\n"
+	"\tstruct @N@_vtab* vtab = (struct @N@_vtab*)pVTab;\n"
+	"\tstruct @N@_cursor* cur = sqlite3_malloc(sizeof(*cur));\n"
+	"\tint ret = SQLITE_OK;\n"
+	"\tif(!cur)\n"
+	"\t\treturn SQLITE_NOMEM;\n"
+	"\tmemset(cur,0,sizeof(*cur));\n"
+	"\tif(vtab->idle) {\n"
+	"\t\tcur->stmt = vtab->idle;\n"
+	"\t\tvtab->idle = NULL;\n"
+	"\t} else if((ret = sqlite3_prepare_v3(vtab->db,@N@_sql,-1,SQLITE_PREPARE_PERSISTENT,&cur->stmt,NULL)) != SQLITE_OK)\n"
+	"\t\tvtab->base.zErrMsg = sqlite3_mprintf(\"%s\",sqlite3_errmsg(vtab->db));\n"
+	"\telse if(sqlite3_column_count(cur->stmt) != @C@ || sqlite3_bind_parameter_count(cur->stmt) != @P@) {\n"
+	"\t\tvtab->base.zErrMsg = sqlite3_mprintf(\"statement of %s no longer matches its generated module\",@N@_name);\n"
+	"\t\tret = SQLITE_SCHEMA;\n"
+	"\t}\n"
+	"\tif(ret != SQLITE_OK) {\n"
+	"\t\tsqlite3_finalize(cur->stmt);\n"
+	"\t\tsqlite3_free(cur);\n"
+	"\t\treturn ret;\n"
+	"\t}\n"
+	"\t*ppCursor = &cur->base;\n"
+	"\treturn SQLITE_OK;\n"
+	"}\n"
+	"\n"
+	"static int @N@_close(sqlite3_vtab_cursor* pCursor) {\n"
+	"\tstruct @N@_cursor* cur = (struct @N@_cursor*)pCursor;\n"
+	"\tstruct @N@_vtab* vtab = (struct @N@_vtab*)pCursor->pVtab;\n"
+	"\tif(vtab->idle)\n"
+	"\t\tsqlite3_finalize(cur->stmt);\n"
+	"\telse {\n"
+	"\t\tsqlite3_reset(cur->stmt);\n"
+	"\t\tsqlite3_clear_bindings(cur->stmt);\n"
+	"\t\tvtab->idle = cur->stmt;\n"
+	"\t}\n"
+	"\tsqlite3_free(cur);\n"
+	"\treturn SQLITE_OK;\n"
+	"}\n"
+	"\n"
+	"static int @N@_step(struct @N@_cursor* cur) {\n"
+	"\tint ret = sqlite3_step(cur->stmt);\n"
+	"\tcur->done = ret != SQLITE_ROW;\n"
+	"\tif(ret == SQLITE_ROW || ret == SQLITE_DONE)\n"
+	"\t\treturn SQLITE_OK;\n"
+	"\tsqlite3_free(cur->base.pVtab->zErrMsg);\n"
+	"\tcur->base.pVtab->zErrMsg = sqlite3_mprintf(\"%s\",sqlite3_errmsg(((struct @N@_vtab*)cur->base.pVtab)->db));\n"
+	"\treturn ret;\n"
+	"}\n"
+	"\n"
+	"static int @N@_filter(sqlite3_vtab_cursor* pCursor, int idxNum, const char* idxStr, int argc, sqlite3_value** argv) {\n"
+	"\tstruct @N@_cursor* cur = (struct @N@_cursor*)pCursor;\n"
+	"\tint param, i = 0, ret;\n"
+	"\t(void)idxStr, (void)argc;\n"
+	"\tsqlite3_reset(cur->stmt);\n"
+	"\tsqlite3_clear_bindings(cur->stmt);\n"
+	"\tfor(param = 0; param < @P@; param++) {\n"
+	"\t\tcur->params[param] = NULL;\n"
+	"\t\tif(!((unsigned)idxNum & (1u << param)))\n"
+	"\t\t\tcontinue;\n"
+	"\t\tif((ret = sqlite3_bind_value(cur->stmt,param+1,argv[i])) != SQLITE_OK)\n"
+	"\t\t\treturn ret;\n"
+	"\t\tcur->params[param] = argv[i++];\n"
+	"\t}\n"
+	"\tcur->rowid = 1;\n"
+	"\treturn @N@_step(cur);\n"
+	"}\n"
+	"\n"
+	"static int @N@_next(sqlite3_vtab_cursor* pCursor) {\n"
+	"\t((struct @N@_cursor*)pCursor)->rowid++;\n"
+	"\treturn @N@_step((struct @N@_cursor*)pCursor);\n"
+	"}\n"
+	"\n"
+	"static int @N@_eof(sqlite3_vtab_cursor* pCursor) {\n"
+	"\treturn ((struct @N@_cursor*)pCursor)->done;\n"
+	"}\n"
+	"\n"
+	"static int @N@_column(sqlite3_vtab_cursor* pCursor, sqlite3_context* ctx, int i) {\n"
+	"\tstruct @N@_cursor* cur = (struct @N@_cursor*)pCursor;\n"
+	"\tif(i < @C@)\n"
+	"\t\tresult_value(ctx,sqlite3_column_value(cur->stmt,i));\n"
+	"\telse if(cur->params[i-@C@])\n"
+	"\t\tresult_value(ctx,cur->params[i-@C@]);\n"
+	"\treturn SQLITE_OK;\n"
+	"}\n"
+	"\n"
+	"static int @N@_rowid(sqlite3_vtab_cursor* pCursor, sqlite3_int64* pRowid) {\n"
+	"\t*pRowid = ((struct @N@_cursor*)pCursor)->rowid;\n"
+	"\treturn SQLITE_OK;\n"
+	"}\n"
+	"\n"
+	"// eponymous only, as it's the module that stands for the table\n"
+	"static sqlite3_module @N@_module = {\n"
+	"\t.xConnect    = @N@_connect,\n"
+	"\t.xBestIndex  = @N@_best_index,\n"
+	"\t.xDisconnect = @N@_disconnect,\n"
+	"\t.xDestroy    = @N@_disconnect,\n"
+	"\t.xOpen       = @N@_open,\n"
+	"\t.xClose      = @N@_close,\n"
+	"\t.xFilter     = @N@_filter,\n"
+	"\t.xNext       = @N@_next,\n"
+	"\t.xEof        = @N@_eof,\n"
+	"\t.xColumn     = @N@_column,\n"
+	"\t.xRowid      = @N@_rowid,\n"
+	"};\n";
+
+// helpers shared by the tables, ahead of them
+static const char prologue[] =
+	"#include \"sqlite3ext.h\"\n"
+	"SQLITE_EXTENSION_INIT1\n"
+	"\n"
+	"#include <string.h>\n"
+	"\n"
+	"static int popcount(unsigned bits) {\n"
+	"\tint n = 0;\n"
+	"\tfor(; bits; bits &= bits-1)\n"
+	"\t\tn++;\n"
+	"\treturn n;\n"
+	"}\n"
+	"\n"
+	"static void result_value(sqlite3_context* ctx, sqlite3_value* value) {\n"
+	"\tswitch(sqlite3_value_type(value)) {\n"
+	"\tcase SQLITE_INTEGER:\n"
+	"\t\tsqlite3_result_int64(ctx,sqlite3_value_int64(value));\n"
+	"\t\tbreak;\n"
+	"\tcase SQLITE_FLOAT:\n"
+	"\t\tsqlite3_result_double(ctx,sqlite3_value_double(value));\n"
+	"\t\tbreak;\n"
+	"\tcase SQLITE_NULL:\n"
+	"\t\tbreak;\n"
+	"\tdefault:\n"
+	"\t\tsqlite3_result_value(ctx,value);\n"
+	"\t}\n"
+	"}\n";
+
+// a C string literal of s
+static void print_literal(FILE* out, const char* s) {
+	fputc('"',out);
+	for(const unsigned char* p = (const unsigned char*)s; *p; p++)
+		if(*p == '"' || *p == '\\')
+			fprintf(out,"\\%c",*p);
+		else if(*p == '\n')
+			fputs(*(p+1) ? "\\n\"\n\t\"" : "\\n",out);
+		else if(*p < ' ' || *p >= 0x7f || (*p == '?' && p[1] == '?')) // nor trigraphs
+			fprintf(out,"\\%03o",*p);
+		else
+			fputc(*p,out);
+	fputc('"',out);
+}
+
+static void print_template(FILE* out, const char* template, const struct table* table) {
+	for(const char* p = template; *p; p++) {
+		if(*p == '@' && p[1] && p[2] == '@') {
+			if(p[1] == 'N')
+				fputs(table->ident,out);
+			else if(p[1] == 'C')
+				fprintf(out,"%d",table->num_outputs);
+			else if(p[1] == 'P')
+				fprintf(out,"%d",table->num_inputs);
+			p += 2;
+		} else
+			fputc(*p,out);
+	}
+}
+
+static void print_table(FILE* out, const struct table* table) {
+	fprintf(out,"\n// %s\n",table->name);
+	fprintf(out,"static const char %s_name[] = ",table->ident);
+	print_literal(out,table->name);
+	fprintf(out,";\nstatic const char %s_sql[] =\n\t",table->ident);
+	print_literal(out,table->sql);
+	fprintf(out,";\nstatic const char %s_declaration[] =\n\t",table->ident);
+	print_literal(out,table->declaration);
+	fprintf(out,";\n#define %s_COST %.17g\n",table->ident,table->cost);
+	fprintf(out,"#define %s_ROWS %lld\n",table->ident,(long long)table->rows);
+	fprintf(out,"#define %s_UNIQUE %d\n",table->ident,table->unique);
+	// the order the statement yields its rows in, {column, desc}
+	int order_len = 0;
+	fprintf(out,"static const int %s_order[][2] = {",table->ident);
+	for(const char* p = table->ordering; p && *p; order_len++) {
+		char* end;
+		long column = strtol(p,&end,10);
+		long desc = strtol(end,&end,10);
+		fprintf(out,"%s{%ld,%ld}",order_len ? "," : "",column,desc);
+		p = *end ? end+1 : end;
+	}
+	fprintf(out,"%s};\n#define %s_ORDER_LEN %d\n\n",order_len ? "" : "{0,0}",table->ident,order_len);
+	print_template(out,table_template,table);
+}
+
+// what sqlite takes the entry point of an extension to be from its file name, from the definitions here
+static char* entry_point(const char* path) {
+	const char* base = strrchr(path,'/');
+	base = base ? base+1 : path;
+	if(!strncmp(base,"lib",3))
+		base += 3;
+	sqlite3_str* name = sqlite3_str_new(NULL);
+	sqlite3_str_appendall(name,"sqlite3_");
+	for(; *base && *base != '.'; base++)
+		if(isalpha((unsigned char)*base))
+			sqlite3_str_appendchar(name,1,(char)tolower((unsigned char)*base));
+	sqlite3_str_appendall(name,"_init");
+	return sqlite3_str_finish(name);
+}
+
+static char* read_file(const char* path) {
+	FILE* f = fopen(path,"rb");
+	if(!f)
+		return NULL;
+	sqlite3_str* s = sqlite3_str_new(NULL);
+	char buf[4096];
+	size_t n;
+	while((n = fread(buf,1,sizeof(buf),f)) > 0)
+		sqlite3_str_append(s,buf,(int)n);
+	int failed = ferror(f);
+	fclose(f);
+	char* content = sqlite3_str_finish(s);
+	if(failed) {
+		sqlite3_free(content);
+		return NULL;
+	}
+	return content ? content : sqlite3_mprintf("");
+}
+
+// the statement tables the definitions created, as statement_vtab_stats lists them and their shadow tables keep them
+static int load_tables(sqlite3* db, struct table** tables, int* num_tables) {
+	sqlite3_stmt* stmt;
+	int ret = sqlite3_prepare_v2(db,"SELECT name FROM statement_vtab_stats WHERE schema = 'main' ORDER BY name",-1,&stmt,NULL);
+	if(ret != SQLITE_OK)
+		return ret;
+	while((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+		const char* name = (const char*)sqlite3_column_text(stmt,0);
+		char* sql = sqlite3_mprintf("SELECT sql, signature, declaration, cost, rows, is_unique, ordering FROM \"%w_schema\"",name);
+		sqlite3_stmt* shadow = NULL;
+		if(!sql || (ret = sqlite3_prepare_v2(db,sql,-1,&shadow,NULL)) != SQLITE_OK || (ret = sqlite3_step(shadow)) != SQLITE_ROW) {
+			sqlite3_free(sql);
+			sqlite3_finalize(shadow);
+			sqlite3_finalize(stmt);
+			return !sql ? SQLITE_NOMEM : ret == SQLITE_DONE ? SQLITE_CORRUPT : ret;
+		}
+		sqlite3_free(sql);
+		struct table table;
+		memset(&table,0,sizeof(table));
+		const char* declaration = (const char*)sqlite3_column_text(shadow,2);
+		if(sscanf((const char*)sqlite3_column_text(shadow,1),"%d %d",&table.num_outputs,&table.num_inputs) != 2 || !declaration) {
+			sqlite3_finalize(shadow);
+			continue;
+		}
+		// bulk tables take their parameters as tuples, which the generated module doesn't
+		if(strstr(declaration,",tuples hidden")) {
+			fprintf(stderr,"%s: skipped, bulk tables aren't supported\n",name);
+			sqlite3_finalize(shadow);
+			continue;
+		}
+		if(table.num_inputs > 30) {
+			fprintf(stderr,"%s: skipped, more than the 30 parameters idxNum has bits for\n",name);
+			sqlite3_finalize(shadow);
+			continue;
+		}
+		table.cost = sqlite3_column_double(shadow,3);
+		table.rows = sqlite3_column_int64(shadow,4);
+		table.unique = sqlite3_column_int(shadow,5);
+		table.name = sqlite3_mprintf("%s",name);
+		table.ident = sqlite3_mprintf("t%d_%s",*num_tables,name);
+		table.sql = sqlite3_mprintf("%s",sqlite3_column_text(shadow,0));
+		table.declaration = sqlite3_mprintf("%s",declaration);
+		table.ordering = sqlite3_mprintf("%s",sqlite3_column_text(shadow,6) ? (const char*)sqlite3_column_text(shadow,6) : "");
+		sqlite3_finalize(shadow);
+		struct table* grown = sqlite3_realloc64(*tables,sizeof(**tables)*(*num_tables+1));
+		if(!grown || !table.name || !table.ident || !table.sql || !table.declaration || !table.ordering) {
+			sqlite3_finalize(stmt);
+			return SQLITE_NOMEM;
+		}
+		for(char* p = table.ident; *p; p++)
+			if(!isalnum((unsigned char)*p))
+				*p = '_';
+		*tables = grown;
+		(*tables)[(*num_tables)++] = table;
+	}
+	sqlite3_finalize(stmt);
+	return ret == SQLITE_DONE ? SQLITE_OK : ret;
+}
+
+int main(int argc, char** argv) {
+	if(argc < 2 || argc > 3) {
+		fprintf(stderr,"usage: %s definitions.sql [database] > extension.c\n",argv[0]);
+		return 2;
+	}
+	char* definitions = read_file(argv[1]);
+	if(!definitions) {
+		fprintf(stderr,"%s: can't be read\n",argv[1]);
+		return 1;
+	}
+	// the definitions are applied to the database they're meant for, if given, so that their statements can refer
+	// to its tables. as they're rolled back it's left as it was
+	sqlite3* db = NULL;
+	char* err = NULL;
+	struct table* tables = NULL;
+	int num_tables = 0, ret;
+	if((ret = sqlite3_open(argc > 2 ? argv[2] : ":memory:",&db)) != SQLITE_OK
+		|| (ret = sqlite3_statementvtab_init(db,&err,NULL)) != SQLITE_OK
+		|| (ret = sqlite3_exec(db,"BEGIN",NULL,NULL,&err)) != SQLITE_OK
+		|| (ret = sqlite3_exec(db,definitions,NULL,NULL,&err)) != SQLITE_OK
+		|| (ret = load_tables(db,&tables,&num_tables)) != SQLITE_OK) {
+		fprintf(stderr,"%s: %s\n",argv[1],err ? err : db ? sqlite3_errmsg(db) : sqlite3_errstr(ret));
+		sqlite3_free(err);
+		sqlite3_free(definitions);
+		sqlite3_close(db);
+		return 1;
+	}
+	sqlite3_exec(db,"ROLLBACK",NULL,NULL,NULL);
+	sqlite3_close(db);
+	sqlite3_free(definitions);
+
+	char* init = entry_point(argv[1]);
+	if(!init) {
+		fprintf(stderr,"out of memory\n");
+		return 1;
+	}
+	printf("/*\n * Generated from %s by codegen, do not edit.\n * Each table is an eponymous module specialized to its statement, so there's no need to create it.\n */\n\n",argv[1]);
+	fputs(prologue,stdout);
+	for(int i = 0; i < num_tables; i++)
+		print_table(stdout,&tables[i]);
+	printf("\n#ifdef _WIN32\n__declspec(dllexport)\n#endif\n");
+	printf("int %s(sqlite3* db, char** pzErrMsg, const sqlite3_api_routines* pApi) {\n",init);
+	printf("\tint ret = SQLITE_OK;\n\t(void)pzErrMsg;\n\tSQLITE_EXTENSION_INIT2(pApi);\n");
+	for(int i = 0; i < num_tables; i++)
+		printf("\tif(ret == SQLITE_OK)\n\t\tret = sqlite3_create_module(db,%s_name,&%s_module,NULL);\n",tables[i].ident,tables[i].ident);
+	printf("\treturn ret;\n}\n");
+	sqlite3_free(init);
+	for(int i = 0; i < num_tables; i++) {
+		sqlite3_free(tables[i].name);
+		sqlite3_free(tables[i].ident);
+		sqlite3_free(tables[i].sql);
+		sqlite3_free(tables[i].declaration);
+		sqlite3_free(tables[i].ordering);
+	}
+	sqlite3_free(tables);
+	return fflush(stdout) ? 1 : 0;
+}
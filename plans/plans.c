@@ -0,0 +1,279 @@
+/*
+ * Plan regression suite, printing the query plans of the queries in a script along with the xBestIndex calls of
+ * statement tables they took and the plans of the statements as rewritten for them, for the plans target of the
+ * Makefile to compare with those expected of the SQLite version it's built with.
+ * Includes statement_vtab.c itself so as to look into the choices it makes.
+ * In the interest of compatibility with SQLite's own license (or rather lack thereof),
+ * the author disclaims copyright to this source code.
+ */
+
+#include "../statement_vtab.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static sqlite3* db;
+static int logging; // whether xBestIndex calls are printed, only while the query of the script is planned
+
+// the columns of a statement table as declared, hidden ones included, to print constraints by name
+static char** columns;
+static int num_columns;
+
+static void columns_free(void) {
+	for(int i = 0; i < num_columns; i++)
+		sqlite3_free(columns[i]);
+	sqlite3_free(columns);
+	columns = NULL;
+	num_columns = 0;
+}
+
+// looked up as xBestIndex is called, which is free to run statements of its own
+static int columns_load(const struct statement_vtab* vtab) {
+	sqlite3_stmt* stmt;
+	columns_free();
+	int ret = sqlite3_prepare_v2(db,"SELECT name FROM pragma_table_xinfo(?1,?2)",-1,&stmt,NULL);
+	if(ret != SQLITE_OK)
+		return ret;
+	sqlite3_bind_text(stmt,1,vtab->name,-1,SQLITE_STATIC);
+	sqlite3_bind_text(stmt,2,vtab->schema,-1,SQLITE_STATIC);
+	while((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+		char** more = sqlite3_realloc64(columns,sizeof(*columns)*(num_columns+1));
+		if(!more || !(more[num_columns] = sqlite3_mprintf("%s",sqlite3_column_text(stmt,0)))) {
+			columns = more ? more : columns;
+			ret = SQLITE_NOMEM;
+			break;
+		}
+		columns = more;
+		num_columns++;
+	}
+	sqlite3_finalize(stmt);
+	return ret == SQLITE_DONE ? SQLITE_OK : ret;
+}
+
+static const char* column_name(int i) {
+	return i >= 0 && i < num_columns ? columns[i] : "rowid";
+}
+
+// a constraint as in "a=" or "c LIKE", with the column left out of limits and offsets
+static void print_constraint(const char* separator, int column, int op) {
+	const char* name;
+	switch(op) {
+	case SQLITE_INDEX_CONSTRAINT_EQ: name = "="; break;
+	case SQLITE_INDEX_CONSTRAINT_GT: name = ">"; break;
+	case SQLITE_INDEX_CONSTRAINT_LE: name = "<="; break;
+	case SQLITE_INDEX_CONSTRAINT_LT: name = "<"; break;
+	case SQLITE_INDEX_CONSTRAINT_GE: name = ">="; break;
+	case SQLITE_INDEX_CONSTRAINT_NE: name = "<>"; break;
+	case SQLITE_INDEX_CONSTRAINT_MATCH: name = " MATCH"; break;
+	case SQLITE_INDEX_CONSTRAINT_LIKE: name = " LIKE"; break;
+	case SQLITE_INDEX_CONSTRAINT_GLOB: name = " GLOB"; break;
+	case SQLITE_INDEX_CONSTRAINT_REGEXP: name = " REGEXP"; break;
+	case SQLITE_INDEX_CONSTRAINT_ISNOT: name = " IS NOT"; break;
+	case SQLITE_INDEX_CONSTRAINT_ISNOTNULL: name = " IS NOT NULL"; break;
+	case SQLITE_INDEX_CONSTRAINT_ISNULL: name = " IS NULL"; break;
+	case SQLITE_INDEX_CONSTRAINT_IS: name = " IS"; break;
+#if SQLITE_VERSION_NUMBER >= 3038000
+	case SQLITE_INDEX_CONSTRAINT_LIMIT:
+		printf("%sLIMIT",separator);
+		return;
+	case SQLITE_INDEX_CONSTRAINT_OFFSET:
+		printf("%sOFFSET",separator);
+		return;
+#endif
+	default: name = " FUNCTION"; break;
+	}
+	printf("%s%s%s",separator,column_name(column),name);
+}
+
+// prints what sqlite asked of the table and what it was told, with the arguments of the plan as the parameters
+// idxStr maps them to, negative for the values of an IN constraint
+static int logged_best_index(sqlite3_vtab* tab, sqlite3_index_info* index_info) {
+	int ret = statement_vtab_best_index(tab,index_info);
+	if(!logging)
+		return ret;
+	const struct statement_vtab* vtab = (const struct statement_vtab*)tab;
+	if(columns_load(vtab) != SQLITE_OK)
+		return SQLITE_NOMEM;
+	printf("xBestIndex %s:",vtab->name);
+	for(int i = 0; i < index_info->nConstraint; i++) {
+		const struct sqlite3_index_constraint* c = &index_info->aConstraint[i];
+		print_constraint(i ? ", " : " ",c->iColumn,c->op);
+		if(!c->usable)
+			printf(" (unusable)");
+	}
+	for(int i = 0; i < index_info->nOrderBy; i++)
+		printf("%s%s%s",i ? ", " : index_info->nConstraint ? "; order by " : " order by ",
+			column_name(index_info->aOrderBy[i].iColumn),index_info->aOrderBy[i].desc ? " desc" : "");
+	if(ret != SQLITE_OK) {
+		printf(" -> %s\n",sqlite3_errstr(ret));
+		return ret;
+	}
+	printf(" -> %d",index_info->idxNum);
+	int num_args = 0;
+	for(int i = 0; i < index_info->nConstraint; i++)
+		if(index_info->aConstraintUsage[i].argvIndex > num_args)
+			num_args = index_info->aConstraintUsage[i].argvIndex;
+	for(int arg = 1; arg <= num_args; arg++)
+		for(int i = 0; i < index_info->nConstraint; i++)
+			if(index_info->aConstraintUsage[i].argvIndex == arg) {
+				int param = index_info->idxStr ? ((const int*)index_info->idxStr)[arg-1] : arg;
+				if(param < 0)
+					printf("%s%s IN ?%d",arg > 1 ? ", " : " ",column_name(index_info->aConstraint[i].iColumn),-param);
+				else {
+					print_constraint(arg > 1 ? ", " : " ",index_info->aConstraint[i].iColumn,index_info->aConstraint[i].op);
+					printf(" ?%d",param);
+				}
+			}
+	printf("; cost %g rows %lld%s\n",index_info->estimatedCost,(long long)index_info->estimatedRows,
+		index_info->orderByConsumed ? " ordered" : "");
+	return ret;
+}
+
+// the statement table a line of the outer plan scans and the variant it scans it with, if any.
+// the parameter map sqlite prints as idxStr after the variant isn't text, so it's cut off
+static const struct statement_vtab* plan_line_vtab(char* line, int* variant) {
+	char* index = strstr(line," VIRTUAL TABLE INDEX ");
+	if(!index || (strncmp(line,"SCAN ",5) && strncmp(line,"SEARCH ",7)))
+		return NULL;
+	char* colon = strchr(index,':');
+	if(colon)
+		*colon = 0;
+	*variant = atoi(index+21);
+	const char* name = strchr(line,' ')+1;
+	int name_len = (int)(index-name);
+	for(struct statement_vtab_context* context = contexts; context; context = context->next)
+		if(context->db == db)
+			for(struct statement_vtab* vtab = context->vtabs; vtab; vtab = vtab->next)
+				if((int)strlen(vtab->name) == name_len && !sqlite3_strnicmp(vtab->name,name,name_len))
+					return vtab;
+	return NULL;
+}
+
+// the outer plan as the shell shows it, followed by the statement each statement table runs for it and its plan
+static int print_plan(const char* sql) {
+	sqlite3_str* out = sqlite3_str_new(NULL);
+	logging = 1;
+	int ret = plan_describe(db,sql,out,1);
+	logging = 0;
+	char* plan = sqlite3_str_finish(out);
+	if(ret != SQLITE_OK) {
+		sqlite3_free(plan);
+		return ret;
+	}
+	sqlite3_str* inner = sqlite3_str_new(NULL);
+	for(char* line = plan, *next; line && *line; line = next) {
+		if((next = strchr(line,'\n')))
+			*next++ = 0;
+		int depth = 0, variant = -1;
+		while(line[depth] == ' ')
+			depth++;
+		const struct statement_vtab* vtab = plan_line_vtab(line+depth,&variant);
+		printf("%s\n",line);
+		if(!vtab || variant < 0 || variant >= vtab->program->num_variants)
+			continue;
+		const struct statement_variant* v = &vtab->program->variants[variant];
+		sqlite3_str_appendf(inner,"%s INDEX %d: ",vtab->name,variant);
+		for(const char* p = v->sql; *p; p++)
+			sqlite3_str_appendchar(inner,1,*p == '\n' ? ' ' : *p);
+		sqlite3_str_appendall(inner,"\n  ");
+		sqlite3_str* statement_plan = sqlite3_str_new(NULL);
+		if((ret = plan_describe(db,v->sql,statement_plan,1)) != SQLITE_OK) {
+			sqlite3_free(sqlite3_str_finish(statement_plan));
+			break;
+		}
+		char* text = sqlite3_str_finish(statement_plan);
+		for(const char* p = text; p && *p; p++)
+			if(*p == '\n')
+				sqlite3_str_appendall(inner,"\n  ");
+			else
+				sqlite3_str_appendchar(inner,1,*p);
+		sqlite3_str_appendall(inner,"\n");
+		sqlite3_free(text);
+	}
+	char* inner_text = sqlite3_str_finish(inner);
+	if(ret == SQLITE_OK && inner_text)
+		fputs(inner_text,stdout);
+	sqlite3_free(inner_text);
+	sqlite3_free(plan);
+	return ret;
+}
+
+// whether the statement is a query to print the plan of rather than part of the setup
+static int is_query(const char* sql) {
+	int type, len;
+	while((len = sql_token(sql,&type)) && type == TOKEN_SPACE)
+		sql += len;
+	return type == TOKEN_WORD && (token_is(sql,len,"SELECT") || token_is(sql,len,"WITH") || token_is(sql,len,"VALUES"));
+}
+
+static char* read_file(const char* path) {
+	FILE* f = fopen(path,"rb");
+	if(!f)
+		return NULL;
+	sqlite3_str* s = sqlite3_str_new(NULL);
+	char buf[4096];
+	size_t n;
+	while((n = fread(buf,1,sizeof(buf),f)) > 0)
+		sqlite3_str_append(s,buf,(int)n);
+	int failed = ferror(f);
+	fclose(f);
+	char* content = sqlite3_str_finish(s);
+	if(failed) {
+		sqlite3_free(content);
+		return NULL;
+	}
+	return content ? content : sqlite3_mprintf("");
+}
+
+int main(int argc, char** argv) {
+	// the expected plans are kept by major and minor version, as the planner rarely changes in patch releases
+	if(argc == 2 && !strcmp(argv[1],"-v")) {
+		printf("%d.%d\n",sqlite3_libversion_number()/1000000,sqlite3_libversion_number()/1000%1000);
+		return 0;
+	}
+	if(argc != 2) {
+		fprintf(stderr,"usage: %s script.sql > plans.txt\n       %s -v\n",argv[0],argv[0]);
+		return 2;
+	}
+	char* script = read_file(argv[1]);
+	if(!script) {
+		fprintf(stderr,"%s: can't be read\n",argv[1]);
+		return 1;
+	}
+	statement_vtab_module.xBestIndex = logged_best_index;
+	char* err = NULL;
+	int ret;
+	if((ret = sqlite3_open(":memory:",&db)) != SQLITE_OK || (ret = sqlite3_statementvtab_init(db,&err,NULL)) != SQLITE_OK) {
+		fprintf(stderr,"%s\n",err ? err : db ? sqlite3_errmsg(db) : sqlite3_errstr(ret));
+		sqlite3_free(err);
+		sqlite3_free(script);
+		sqlite3_close(db);
+		return 1;
+	}
+	const char* sql = script;
+	while(ret == SQLITE_OK && *sql) {
+		sqlite3_stmt* stmt = NULL;
+		const char* tail;
+		if((ret = sqlite3_prepare_v2(db,sql,-1,&stmt,&tail)) != SQLITE_OK || !stmt)
+			break;
+		if(is_query(sql)) {
+			// sqlite takes the statement from the start of the comments before it, which name the case
+			printf("%s%.*s\n",sql == script ? "" : "\n",(int)(tail-sql),sql);
+			ret = print_plan(sqlite3_sql(stmt));
+		} else {
+			while((ret = sqlite3_step(stmt)) == SQLITE_ROW)
+				;
+			ret = ret == SQLITE_DONE ? SQLITE_OK : ret;
+		}
+		sqlite3_finalize(stmt);
+		for(sql = tail; *sql == ' ' || *sql == '\t' || *sql == '\n' || *sql == '\r'; sql++)
+			;
+	}
+	if(ret != SQLITE_OK)
+		fprintf(stderr,"%s: %s\n%.*s\n",argv[1],sqlite3_errmsg(db),(int)strcspn(sql,";"),sql);
+	columns_free();
+	sqlite3_free(script);
+	sqlite3_close(db);
+	return ret == SQLITE_OK ? 0 : 1;
+}
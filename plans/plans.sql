@@ -0,0 +1,88 @@
+-- representative statement tables of the plan regression suite, see the plans target of the Makefile.
+-- statements that aren't queries set things up, and each query is printed with the comments before it
+CREATE TABLE t(a INTEGER PRIMARY KEY, b INT, c TEXT);
+CREATE INDEX t_b ON t(b);
+CREATE INDEX t_c ON t(c);
+CREATE TABLE o(x INT);
+CREATE TABLE ids(x INT);
+CREATE TABLE events(id INTEGER PRIMARY KEY, user TEXT, ts INT, kind TEXT);
+CREATE INDEX events_user_ts ON events(user, ts);
+
+CREATE VIRTUAL TABLE f USING statement((SELECT b*2 AS d, c FROM t WHERE a = :a));
+CREATE VIRTUAL TABLE s USING statement((SELECT a, c FROM t WHERE b >= :lo AND (:step IS NULL OR a % :step = 0) AND b < :hi));
+CREATE VIRTUAL TABLE by_c USING statement((SELECT a, b FROM t WHERE c = ?));
+CREATE VIRTUAL TABLE recent USING statement((SELECT id, ts, kind FROM events WHERE user = :user ORDER BY ts DESC));
+CREATE VIRTUAL TABLE everything USING statement((SELECT a, b, c FROM t));
+CREATE VIRTUAL TABLE dates USING statement((SELECT strftime('%Y', :date) AS year, strftime('%m', :date) AS month));
+CREATE VIRTUAL TABLE given USING statement((SELECT a, c FROM t WHERE b = :b), cost=5, rows=2);
+CREATE VIRTUAL TABLE bulk_f USING statement((SELECT b*2 AS d FROM t WHERE a = :a), bulk);
+CREATE VIRTUAL TABLE counts USING statement((WITH n AS MATERIALIZED (SELECT b, count(*) AS k FROM t GROUP BY b) SELECT b, k FROM n WHERE k > :min));
+
+-- table-valued function called with a column of the outer table
+SELECT o.x, f.d FROM o, f(o.x);
+
+-- table-valued function called with a constant
+SELECT d, c FROM f(5);
+
+-- anonymous parameter
+SELECT a FROM by_c('x');
+
+-- sparse named parameters, taking the idxStr path
+SELECT a FROM s WHERE lo = 1 AND hi = 5;
+
+-- every named parameter
+SELECT a FROM s WHERE lo = 1 AND hi = 5 AND step = 2;
+
+-- parameters taken from a join
+SELECT o.x, s.a FROM o, s WHERE s.lo = o.x AND s.hi = o.x + 4;
+
+-- constraint on an output column, applied within the statement
+SELECT a FROM s WHERE lo = 1 AND hi = 5 AND c = 'x';
+
+-- constraints on output columns of a statement without parameters
+SELECT a FROM everything WHERE b > 10 AND c LIKE 'x%';
+
+-- IN list on a parameter
+SELECT d FROM f WHERE a IN (1, 2, 3);
+
+-- IN subquery on a parameter
+SELECT d FROM f WHERE a IN (SELECT x FROM ids);
+
+-- IN list on an output column
+SELECT a FROM everything WHERE b IN (1, 2, 3);
+
+-- order the statement already yields
+SELECT id FROM recent('bob') ORDER BY ts DESC;
+
+-- order the statement doesn't yield
+SELECT id FROM recent('bob') ORDER BY ts;
+
+-- order by an indexed output column, applied within the statement
+SELECT a FROM everything ORDER BY b;
+
+-- limit applied within the statement
+SELECT id FROM recent('bob') LIMIT 10;
+
+-- distinct rows
+SELECT DISTINCT b FROM everything;
+
+-- grouping
+SELECT b, count(*) FROM everything GROUP BY b;
+
+-- statement without a FROM clause
+SELECT year FROM dates('2019-11-13');
+
+-- estimates given as options
+SELECT o.x, given.a FROM o, given(o.x);
+
+-- join of two statement tables
+SELECT f.d, by_c.a FROM everything, f(everything.a), by_c(f.c);
+
+-- statement table joined to a table on an output column
+SELECT t.a FROM everything JOIN t ON t.b = everything.a WHERE everything.c = 'x';
+
+-- bulk input
+SELECT ordinal, d FROM bulk_f('[1, 2, 3]');
+
+-- materialized common table expression, scanned without being a table
+SELECT b FROM counts(2);
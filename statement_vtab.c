@@ -4,31 +4,859 @@
  * the author disclaims copyright to this source code.
  */
 
+// for clock_gettime
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200112L
+#endif
+
 #include "sqlite3ext.h"
 SQLITE_EXTENSION_INIT1
 
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
 #include <assert.h>
+#include <time.h>
+
+// number of idle prepared statements kept per variant unless overridden by the pool option
+#ifndef STATEMENT_VTAB_POOL_SIZE
+#define STATEMENT_VTAB_POOL_SIZE 4
+#endif
+
+// limit on the number of rewritten forms of the statement kept per vtab
+#ifndef STATEMENT_VTAB_MAX_VARIANTS
+#define STATEMENT_VTAB_MAX_VARIANTS 64
+#endif
+
+// limit on the number of distinct parameter maps handed out as idxStr per vtab, others are allocated per query plan
+#ifndef STATEMENT_VTAB_MAX_COLMAPS
+#define STATEMENT_VTAB_MAX_COLMAPS 64
+#endif
+
+// row estimates in the absence of statistics, matching what SQLite itself assumes for tables and virtual tables
+#define STATEMENT_VTAB_TABLE_ROWS 1048576
+#define STATEMENT_VTAB_EQ_ROWS 10
+#define STATEMENT_VTAB_RANGE_ROWS (STATEMENT_VTAB_TABLE_ROWS/16)
+#define STATEMENT_VTAB_VTAB_ROWS 25
+// values assumed on the right of an IN constraint, as xBestIndex isn't told how many there are
+#define STATEMENT_VTAB_IN_VALUES 25
+
+// limit on the cache of a materialized table unless given by the cache_bytes option
+#define STATEMENT_VTAB_MATERIALIZE_BYTES ((sqlite3_int64)1 << 62)
+
+// limit on the number of combinations of variant and bound parameters observed per vtab with the feedback option
+#ifndef STATEMENT_VTAB_MAX_OBSERVED
+#define STATEMENT_VTAB_MAX_OBSERVED 64
+#endif
+// runs observed before their averages replace the estimates unless given by the feedback option, after which
+// each run weighs as much in the averages
+#define STATEMENT_VTAB_FEEDBACK_RUNS 8
+
+// the process-wide cache of the cache_shared option, split into shards of their own mutex by hash of the key that each
+// take an even part of the memory
+#ifndef STATEMENT_VTAB_SHARED_BYTES
+#define STATEMENT_VTAB_SHARED_BYTES ((sqlite3_int64)64 << 20)
+#endif
+#ifndef STATEMENT_VTAB_SHARED_SHARDS
+#define STATEMENT_VTAB_SHARED_SHARDS 16
+#endif
+
+// vm instructions between looks at the clock with the budget_ms option
+#ifndef STATEMENT_VTAB_BUDGET_OPS
+#define STATEMENT_VTAB_BUDGET_OPS 1000
+#endif
+
+// rounds of inlining statement tables into one another with the inline option
+#ifndef STATEMENT_VTAB_INLINE_DEPTH
+#define STATEMENT_VTAB_INLINE_DEPTH 8
+#endif
+
+// memoized output of a deterministic table unless given by the cache_bytes option
+#ifndef STATEMENT_VTAB_DETERMINISTIC_BYTES
+#define STATEMENT_VTAB_DETERMINISTIC_BYTES (1 << 20)
+#endif
+
+// materialized tables, and the cache of tables that aren't deterministic, need to list the databases on the connection,
+// which is possible since 3.39.0
+#if SQLITE_VERSION_NUMBER >= 3039000
+#define STATEMENT_VTAB_MATERIALIZE 1
+#endif
+
+// materialize=incremental follows the connection's own writes with the preupdate hook, which sqlite only has when built
+// with it and the extension api doesn't provide, so like parallel it needs statement_vtab compiled into the application
+#if defined(SQLITE_CORE) && defined(SQLITE_ENABLE_PREUPDATE_HOOK) && defined(STATEMENT_VTAB_MATERIALIZE)
+#define STATEMENT_VTAB_INCREMENTAL 1
+#endif
+
+// rows written between two reads of an incrementally materialized table beyond which it's run again in full instead
+#ifndef STATEMENT_VTAB_INCREMENTAL_KEYS
+#define STATEMENT_VTAB_INCREMENTAL_KEYS 4096
+#endif
+
+// virtual tables and functions can be declared safe for use in triggers and views of untrusted schemas since 3.31.0
+#if SQLITE_VERSION_NUMBER >= 3031000
+#define STATEMENT_VTAB_INNOCUOUS 1
+#endif
+
+// IN constraints can be processed within one xFilter call since 3.38.0
+#if SQLITE_VERSION_NUMBER >= 3038000
+#define STATEMENT_VTAB_IN 1
+#endif
+
+// xBestIndex can tell whether the query only needs distinct or grouped rows since 3.38.0 too
+#if SQLITE_VERSION_NUMBER >= 3038000
+#define STATEMENT_VTAB_DISTINCT 1
+#endif
+
+// parallel workers read from the snapshot of the calling connection, which the extension api doesn't provide,
+// so these are only available where statement_vtab is compiled into an application along with SQLite itself
+#if defined(SQLITE_CORE) && defined(SQLITE_ENABLE_SNAPSHOT) && SQLITE_VERSION_NUMBER >= 3039000 && !defined(_WIN32)
+#define STATEMENT_VTAB_PARALLEL 1
+#include <pthread.h>
+#endif
+
+// limit on the parameter sets of one scan handed to parallel workers, beyond which the statement is run serially
+#ifndef STATEMENT_VTAB_PARALLEL_MAX_JOBS
+#define STATEMENT_VTAB_PARALLEL_MAX_JOBS 65536
+#endif
+
+// a buffered copy of statement output, num_cols values per row with text and blob payloads kept in one arena
+struct statement_rows {
+	int num_cols;
+	int num_rows;
+	int cap_rows;
+	struct statement_value {
+		union {
+			sqlite3_int64 i;
+			double r;
+			size_t offset;
+		} u;
+		int n;
+		int type;
+	}* values;
+	char* arena;
+	size_t arena_len;
+	size_t arena_cap;
+};
+
+// memoized output of the statement for one set of bound parameters
+struct statement_cache_entry {
+	struct statement_cache_entry* hash_next;
+	struct statement_cache_entry* lru_prev;
+	struct statement_cache_entry* lru_next;
+	sqlite3_uint64 hash;
+	int refs; // one for membership in the cache plus one per cursor reading the rows
+	sqlite3_mutex* mutex; // of the shard of the shared cache it's in, guarding refs as cursors of any connection may have it
+	sqlite3_uint64 generation; // that of the cache when the rows started to be recorded
+	struct statement_rows rows;
+	int key_len;
+	char key[];
+};
+
+struct statement_cache {
+	struct statement_cache_entry** buckets;
+	int num_buckets;
+	int num_entries;
+	struct statement_cache_entry* lru_head; // most recently used
+	struct statement_cache_entry* lru_tail;
+	sqlite3_int64 bytes;
+	sqlite3_int64 max_bytes;
+	sqlite3_int64 hits;
+	sqlite3_int64 misses;
+	sqlite3_int64 evictions;
+	sqlite3_uint64 generation; // bumped whenever the cache is invalidated, so that rows recorded before aren't inserted
+};
+
+// the statement as given, or rewritten to apply constraints of the outer query within it
+struct statement_variant {
+	char* sql;
+	int sql_len;
+	int valid; // whether the rewritten statement could be prepared; failures are kept to avoid retrying them
+	int sorted; // whether the statement has to sort its entire output to produce the order asked for
+	double cost;
+	sqlite3_int64 rows;
+	// prepared statements released by cursors, handed out again to the next one using this variant
+	sqlite3_stmt** pool;
+	int pool_len;
+	int pool_cap;
+	int serial; // whether the variant failed to prepare on parallel workers, which isn't retried
+	char* key; // the sql the way the key of the program has it, once the shared cache needed it
+	int key_len;
+};
+
+// the statement of the tables on a connection whose sql only differs in whitespace and comments, shared by them along with
+// its rewritten forms and their pools of prepared statements. what's derived from the statement is shared only by tables
+// with the very same sql, as sqlite takes the names of unaliased columns from the sql as written
+struct statement_program {
+	struct statement_program* next; // in the list kept by the context
+	int refs;
+	sqlite3_uint64 hash;
+	char* key; // the sql with whitespace and comments each reduced to a single space
+	int key_len;
+	struct statement_variant* variants; // variants[0] is the statement as given by the first of the tables
+	int num_variants;
+	int derived; // whether the estimates and order below were derived yet
+	double cost;
+	sqlite3_int64 rows;
+	int unique; // or -1 where the table deriving the rest took the unique option instead
+	struct statement_order* order;
+	int order_len;
+};
+
+// runtime counters of a statement table, as reported by the statement_vtab_stats table
+struct statement_stats {
+	sqlite3_int64 prepares;
+	sqlite3_int64 opens;
+	sqlite3_int64 filters;
+	sqlite3_int64 rows;
+	sqlite3_int64 step_ns;
+	sqlite3_int64 max_step_ns;
+	sqlite3_int64 budget_exceeded; // calls that ran out of the budget of the budget_steps or budget_ms options
+	sqlite3_int64 status[4]; // totals of stats_status counters over released statements
+};
+
+static const int stats_status[] = {SQLITE_STMTSTATUS_FULLSCAN_STEP,SQLITE_STMTSTATUS_SORT,SQLITE_STMTSTATUS_AUTOINDEX,SQLITE_STMTSTATUS_VM_STEP};
+
+// shared by the modules and functions registered on a connection, freed along with the last of them
+struct statement_vtab_context {
+	int refs;
+	int timing; // steps are only timed once the stats table has been read, to keep them free otherwise
+	int preupdate; // whether the preupdate hook of the connection was taken for incrementally materialized tables
+	struct statement_vtab* vtabs;
+	struct statement_program* programs;
+	struct statement_function* functions;
+	// the progress handler as the application set it through sqlite3_statementvtab_progress_handler, which sqlite
+	// has no way of reading back, put back in place once the statements of tables with a budget are done.
+	// tables with a budget can't be used until the application has set one that way, if only to none at all
+	sqlite3* db;
+	struct statement_vtab_context* next; // in the list of contexts of the process, to find them by connection
+	int progress_set;
+	int progress_ops;
+	int (*progress)(void*);
+	void* progress_arg;
+	sqlite3_int64 progress_count; // instructions since the application's handler was last called
+	struct statement_budget* budget; // of the innermost call of a table with a budget running on the connection
+};
+
+// what remains of the budget of a call to xFilter or xNext, kept on its stack while the progress handler enforces it.
+// statement tables running within the statement of another get their own, with the outer budgets still checked
+struct statement_budget {
+	struct statement_vtab_context* context;
+	struct statement_budget* outer;
+	struct statement_cursor* cur;
+	sqlite3_stmt* stmt; // that of cur as the vm instructions of the call are counted from start
+	sqlite3_int64 start;
+	sqlite3_int64 seen; // the count of stmt as of the step running now, which the handler fired for fired times
+	sqlite3_int64 fired;
+	sqlite3_int64 nested; // instructions of the calls that ran within this one, which count towards it as well
+	sqlite3_int64 steps; // vm instructions the call may take, -1 for no limit
+	sqlite3_int64 deadline; // in clock_ns, 0 for none
+	int interval; // instructions between calls of the handler
+	int exceeded;
+};
+
+// the scalar function of a table with the function option, registered once per name and number of arguments on a connection
+// and then taken over by whichever table registers it again, as sqlite won't replace functions while statements are running
+struct statement_function {
+	struct statement_function* next; // in the list kept by the context
+	struct statement_vtab_context* context;
+	char* name;
+	int num_args;
+	// to connect to the table again should sqlite have disconnected it, such as after a schema change
+	char* schema;
+	char* table;
+	struct statement_vtab* vtab; // while connected
+	sqlite3_stmt* stmt; // kept for the function by vtab, with calls made while it runs taking others from the pool
+};
+
+// with materialize=incremental, a statement over a single rowid table keeps its one result up to date with the writes of
+// the connection by running it again for the rowids they touched only, as recorded by the preupdate hook. the rows
+// of the result carry the rowid they come from as an extra last column, indexed by slots
+struct statement_delta {
+	char* schema; // of the table, as named to the hook
+	char* table;
+	char* keyed_sql; // the statement with the rowid as its extra column
+	sqlite3_stmt* row_stmt; // the same for the one rowid bound to ?1
+	struct statement_cache_entry* entry; // the result in the cache, with a reference of its own
+	int* slots; // open addressing from rowid to 1 + row of entry, 0 for none
+	int num_slots;
+	size_t garbage; // bytes of the arena of entry that rows no longer refer to
+	sqlite3_int64* keys; // rowids written since the result was last brought up to date
+	int num_keys;
+	int cap_keys;
+	int overflow; // too many of them to be worth it, or no memory to record them
+	char* others; // data and schema versions as other connections and schema changes would move them
+	int others_len;
+};
 
 struct statement_vtab {
 	sqlite3_vtab base;
 	sqlite3* db;
+	struct statement_vtab_context* context;
+	struct statement_vtab* prev; // in the list of statement tables kept by context
+	struct statement_vtab* next;
+	char* schema;
+	char* name;
+	char* function; // name of the scalar function registered with the function option
+	int deterministic; // whether the output of the statement is promised to depend on nothing but its parameters
+	int innocuous;
+	int inline_tables; // whether statement tables called from the statement are inlined into it
+	sqlite3_int64 slow_ns; // runs of the statement taking at least this long are logged with the slow_ms option, -1 if not
+	// each call to xFilter and xNext may take this many vm instructions or nanoseconds, 0 for no limit, failing with
+	// SQLITE_INTERRUPT or, with the budget_truncate option, ending the rows of the table there
+	sqlite3_int64 budget_steps;
+	sqlite3_int64 budget_ns;
+	int budget_truncate;
+	struct statement_stats stats;
+	char* sql; // that of program when it's the same
+	size_t sql_len;
+	int num_inputs;
+	int num_outputs;
+	struct statement_program* program; // its variants are selected by idxNum
+	// parameter maps of query plans, kept for the lifetime of the vtab so that plans can share them as idxStr
+	struct statement_colmap {
+		int len;
+		int map[];
+	}** colmaps;
+	int num_colmaps;
+	int pool_max;
+	int prefetch; // rows stepped at a time into a buffer of the cursor, 0 to serve them straight from the statement
+	struct statement_cache cache; // only used when max_bytes is set by the cache_bytes or materialize options
+	// with the cache_shared option, the database file the rows are kept under in the shared cache instead, NULL for
+	// databases without one, which keep to the cache of the table
+	int cache_shared;
+	struct statement_shared_file* shared_file;
+	// with the materialize option, or cache_bytes without deterministic, the cache is invalidated whenever the data
+	// versions of the databases change
+	int materialize;
+	char* data_versions;
+	int data_versions_len;
+	int incremental; // as asked for with materialize=incremental, delta only being set for statements it applies to
+	struct statement_delta* delta;
+	// with the bulk option the parameters are given as tuples through a single hidden column instead
+	int bulk;
+	// with the parallel option the parameter sets of IN constraints and bulk tuples are run on reader connections
+	int parallel;
+	struct statement_worker {
+		sqlite3* db;
+		sqlite3_stmt** stmts; // by variant, prepared as needed
+		int num_stmts;
+	}* workers;
+	int num_workers;
+	int workers_busy; // by the batch of a cursor, other cursors run serially meanwhile
+	// planner estimates, derived from the statement's own query plan unless given as options
+	double cost;
+	sqlite3_int64 rows;
+	int unique;
+	int cost_given;
+	int rows_given;
+	// with the feedback option, the rows runs of the statement yielded and the vm steps they took on average by variant
+	// and parameters bound, which xBestIndex reports instead of the estimates not given as options once it has seen
+	// enough runs. vm steps rather than time as they stay put from one run to the next and scale much like sqlite's costs
+	int feedback;
+	struct statement_observed {
+		int variant;
+		sqlite3_uint64 params; // by bit of parameter index-1, the last bit standing for any after it
+		sqlite3_int64 runs;
+		double rows;
+		double vm_steps;
+	}* observed;
+	int num_observed;
+	// the order the statement yields its rows in, as far as it could be determined from its order by
+	struct statement_order {
+		int column;
+		int desc;
+	}* order;
+	int order_len;
+	// tables connected to from what the registry kept check this against the statement once it's prepared
+	char* signature;
+	int verified;
+	// with the registry option, what other connections of the process derived for the table, which the signature
+	// and order are then taken from
+	int registry;
+	struct statement_registered* registered;
+};
+
+// what was derived for a table with the registry option, shared by the connections of the process to the same file
+// so that connecting to the table needn't go through the shadow table. like that it's only kept if the sql matches,
+// the signature being checked once the statement is prepared
+struct statement_registered {
+	struct statement_registered* next;
+	int refs; // one for being in the registry
+	char* key; // database file, then the name of the table after a NUL
+	size_t key_len;
+	int schema_version; // of the database when it was derived, which it only applies to along with the key
 	char* sql;
 	size_t sql_len;
+	char* signature;
+	char* declaration;
 	int num_inputs;
 	int num_outputs;
+	double cost;
+	sqlite3_int64 rows;
+	int unique;
+	int sorted;
+	struct statement_order* order;
+	int order_len;
 };
 
+static struct statement_registered* registry; // under the registry mutex
+static struct statement_vtab_context* contexts; // likewise
+
+// guards the registry of the registry option and the list of contexts. the extension allocates its own unless compiled
+// with STATEMENT_VTAB_REGISTRY_MUTEX set to one of sqlite's static mutexes, such as SQLITE_MUTEX_STATIC_APP1
+#ifdef STATEMENT_VTAB_REGISTRY_MUTEX
+static int registry_mutex_setup(void) {
+	return SQLITE_OK;
+}
+
+static sqlite3_mutex* registry_mutex(void) {
+	return sqlite3_mutex_alloc(STATEMENT_VTAB_REGISTRY_MUTEX);
+}
+#else
+// allocated by the first connection to load the extension, under sqlite's main mutex, and kept for the life of the process
+// since there's no telling when the last connection is done with it. every connection loads the extension before
+// using the mutex, so none sees it unset
+static sqlite3_mutex* registry_own_mutex;
+
+static int registry_mutex_setup(void) {
+	sqlite3_mutex* main = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_MAIN);
+	sqlite3_mutex_enter(main);
+	if(!registry_own_mutex)
+		registry_own_mutex = sqlite3_mutex_alloc(SQLITE_MUTEX_FAST);
+	int ret = registry_own_mutex || !sqlite3_threadsafe() ? SQLITE_OK : SQLITE_NOMEM;
+	sqlite3_mutex_leave(main);
+	return ret;
+}
+
+static sqlite3_mutex* registry_mutex(void) {
+	return registry_own_mutex;
+}
+#endif
+
+// the shared cache, set up under the registry mutex by the first table with the cache_shared option and
+// freed along with the last of them
+static struct statement_shard {
+	sqlite3_mutex* mutex;
+	struct statement_cache cache;
+} shards[STATEMENT_VTAB_SHARED_SHARDS];
+static int shared_users;
+
+// a database file with tables using the shared cache. its generation is part of the key of their results, and moves
+// on whenever a connection finds the file changed, so that the results from before are no longer found.
+// connections can't tell what changed before their tables first looked, so each table moves it on then too
+static struct statement_shared_file {
+	struct statement_shared_file* next;
+	int refs;
+	char* name;
+	sqlite3_mutex* mutex; // of the generation
+	sqlite3_uint64 generation;
+}* shared_files; // under the registry mutex
+
+// by the upper bits of the hash, as the buckets of a shard go by the lower ones
+static struct statement_shard* shared_shard(sqlite3_uint64 hash) {
+	return &shards[(hash >> 32) % STATEMENT_VTAB_SHARED_SHARDS];
+}
+
 struct statement_cursor {
 	sqlite3_vtab_cursor base;
 	sqlite3_stmt* stmt;
+	int variant;
 	int rowid;
-	int param_argc;
-	sqlite3_value** param_argv;
+	sqlite3_value** param_argv; // values bound to each parameter, by parameter index
+
+	struct statement_cache_entry* entry; // cache hit whose rows are being served instead of stepping stmt
+	int entry_row;
+	struct statement_cache_entry* fill; // cache miss whose rows are being recorded as stmt is stepped
+	struct statement_cache_entry* prefetch; // rows stepped ahead with the prefetch option, served as entry
+	int run_done; // whether the run of stmt the rows in prefetch came from has completed
+	// what the current run of stmt took so far, for the slow_ms and feedback options
+	int run_started;
+	sqlite3_int64 run_ns;
+	sqlite3_int64 run_rows;
+	int run_vm_steps; // of stmt when the run started
+	int observed; // where runs of the scan are recorded in vtab->observed, -1 if they aren't
+
+	// values of IN constraints processed all at once, copied as sqlite only keeps them valid during xFilter.
+	// the statement is run once for each combination of these, changing the last one first
+	struct statement_in {
+		int param;
+		int at;
+		int num_values;
+		sqlite3_value** values;
+	}* in;
+	int in_len;
+	int in_cap;
+
+	// tuples of a bulk table, with the statement run for each in turn from the row of tuples_stmt that starts it.
+	// tuples are the children of the root of the json tree and their own children the parameters
+	sqlite3_stmt* tuples_stmt;
+	int tuples_done;
+	sqlite3_int64 tuples_root;
+	sqlite3_int64 ordinal;
+	sqlite3_value* tuples;
+
+	struct statement_batch* batch; // parameter sets being run by parallel workers, their rows served as entry
 };
 
-static char* build_create_statement(sqlite3_stmt* stmt) {
+static sqlite3_int64 clock_ns(void) {
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec*(sqlite3_int64)1000000000 + ts.tv_nsec;
+#else
+	return clock()*((sqlite3_int64)1000000000/CLOCKS_PER_SEC);
+#endif
+}
+
+static void rows_free(struct statement_rows* rows) {
+	sqlite3_free(rows->values);
+	sqlite3_free(rows->arena);
+}
+
+static sqlite3_int64 rows_bytes(const struct statement_rows* rows) {
+	return (sqlite3_int64)rows->cap_rows*rows->num_cols*sizeof(*rows->values) + rows->arena_cap;
+}
+
+static int rows_append(struct statement_rows* rows, sqlite3_stmt* stmt) {
+	if(rows->num_rows == rows->cap_rows) {
+		int cap = rows->cap_rows ? rows->cap_rows*2 : 4;
+		void* values = sqlite3_realloc64(rows->values,sizeof(*rows->values)*rows->num_cols*cap);
+		if(!values && rows->num_cols)
+			return SQLITE_NOMEM;
+		rows->values = values;
+		rows->cap_rows = cap;
+	}
+	struct statement_value* row = rows->values + (size_t)rows->num_rows*rows->num_cols;
+	for(int i = 0; i < rows->num_cols; i++) {
+		const void* p = NULL;
+		switch((row[i].type = sqlite3_column_type(stmt,i))) {
+		case SQLITE_INTEGER:
+			row[i].u.i = sqlite3_column_int64(stmt,i);
+			break;
+		case SQLITE_FLOAT:
+			row[i].u.r = sqlite3_column_double(stmt,i);
+			break;
+		case SQLITE_TEXT:
+			p = sqlite3_column_text(stmt,i);
+			break;
+		case SQLITE_BLOB:
+			p = sqlite3_column_blob(stmt,i);
+			break;
+		}
+		if(row[i].type != SQLITE_TEXT && row[i].type != SQLITE_BLOB)
+			continue;
+		size_t n = row[i].n = sqlite3_column_bytes(stmt,i);
+		if(rows->arena_len+n > rows->arena_cap) {
+			size_t cap = rows->arena_cap ? rows->arena_cap : 256;
+			while(cap < rows->arena_len+n)
+				cap *= 2;
+			char* arena = sqlite3_realloc64(rows->arena,cap);
+			if(!arena)
+				return SQLITE_NOMEM;
+			rows->arena = arena;
+			rows->arena_cap = cap;
+		}
+		if(n)
+			memcpy(rows->arena+rows->arena_len,p,n);
+		row[i].u.offset = rows->arena_len;
+		rows->arena_len += n;
+	}
+	rows->num_rows++;
+	return SQLITE_OK;
+}
+
+static void rows_result(const struct statement_rows* rows, int row, int col, sqlite3_context* ctx) {
+	const struct statement_value* value = rows->values + (size_t)row*rows->num_cols + col;
+	// empty payloads may not have an arena to point into, but a NULL pointer would make the result NULL
+	const char* p = rows->arena ? rows->arena+value->u.offset : "";
+	switch(value->type) {
+	case SQLITE_INTEGER:
+		sqlite3_result_int64(ctx,value->u.i);
+		break;
+	case SQLITE_FLOAT:
+		sqlite3_result_double(ctx,value->u.r);
+		break;
+	case SQLITE_TEXT:
+		sqlite3_result_text64(ctx,p,value->n,SQLITE_TRANSIENT,SQLITE_UTF8);
+		break;
+	case SQLITE_BLOB:
+		sqlite3_result_blob64(ctx,p,value->n,SQLITE_TRANSIENT);
+		break;
+	}
+}
+
+static sqlite3_uint64 hash_bytes(const char* p, size_t n) {
+	sqlite3_uint64 hash = 0xcbf29ce484222325ull; // FNV-1a
+	while(n--)
+		hash = (hash ^ (unsigned char)*p++) * 0x100000001b3ull;
+	return hash;
+}
+
+static sqlite3_int64 cache_entry_bytes(const struct statement_cache_entry* entry) {
+	return sizeof(*entry) + entry->key_len + rows_bytes(&entry->rows);
+}
+
+static void cache_entry_unref(struct statement_cache_entry* entry) {
+	if(!entry)
+		return;
+	sqlite3_mutex_enter(entry->mutex);
+	int refs = --entry->refs;
+	sqlite3_mutex_leave(entry->mutex);
+	if(!refs) {
+		rows_free(&entry->rows);
+		sqlite3_free(entry);
+	}
+}
+
+static void cache_unlink(struct statement_cache* cache, struct statement_cache_entry* entry) {
+	struct statement_cache_entry** link = &cache->buckets[entry->hash % cache->num_buckets];
+	while(*link != entry)
+		link = &(*link)->hash_next;
+	*link = entry->hash_next;
+	*(entry->lru_prev ? &entry->lru_prev->lru_next : &cache->lru_head) = entry->lru_next;
+	*(entry->lru_next ? &entry->lru_next->lru_prev : &cache->lru_tail) = entry->lru_prev;
+	cache->num_entries--;
+	cache->bytes -= cache_entry_bytes(entry);
+	cache_entry_unref(entry);
+}
+
+static void cache_touch(struct statement_cache* cache, struct statement_cache_entry* entry) {
+	if(cache->lru_head == entry)
+		return;
+	entry->lru_prev->lru_next = entry->lru_next;
+	*(entry->lru_next ? &entry->lru_next->lru_prev : &cache->lru_tail) = entry->lru_prev;
+	entry->lru_prev = NULL;
+	entry->lru_next = cache->lru_head;
+	cache->lru_head->lru_prev = entry;
+	cache->lru_head = entry;
+}
+
+static struct statement_cache_entry* cache_find(struct statement_cache* cache, const char* key, int key_len, sqlite3_uint64 hash) {
+	if(!cache->num_buckets)
+		return NULL;
+	for(struct statement_cache_entry* entry = cache->buckets[hash % cache->num_buckets]; entry; entry = entry->hash_next)
+		if(entry->hash == hash && entry->key_len == key_len && !memcmp(entry->key,key,key_len))
+			return entry;
+	return NULL;
+}
+
+// takes ownership of entry, which is dropped instead if it can never fit
+static void cache_insert(struct statement_cache* cache, struct statement_cache_entry* entry) {
+	sqlite3_int64 bytes = cache_entry_bytes(entry);
+	if(entry->generation != cache->generation || bytes > cache->max_bytes || cache_find(cache,entry->key,entry->key_len,entry->hash)) {
+		cache_entry_unref(entry);
+		return;
+	}
+	while(cache->lru_tail && cache->bytes+bytes > cache->max_bytes) {
+		cache_unlink(cache,cache->lru_tail);
+		cache->evictions++;
+	}
+	if(cache->num_entries >= cache->num_buckets) {
+		int num_buckets = cache->num_buckets ? cache->num_buckets*2 : 64;
+		struct statement_cache_entry** buckets = sqlite3_malloc64(sizeof(*buckets)*num_buckets);
+		if(!buckets && !cache->num_buckets) {
+			cache_entry_unref(entry);
+			return;
+		}
+		if(buckets) { // otherwise just keep chaining in the existing buckets
+			memset(buckets,0,sizeof(*buckets)*num_buckets);
+			for(int i = 0; i < cache->num_buckets; i++)
+				for(struct statement_cache_entry* next, *e = cache->buckets[i]; e; e = next) {
+					next = e->hash_next;
+					e->hash_next = buckets[e->hash % num_buckets];
+					buckets[e->hash % num_buckets] = e;
+				}
+			sqlite3_free(cache->buckets);
+			cache->buckets = buckets;
+			cache->num_buckets = num_buckets;
+		}
+	}
+	struct statement_cache_entry** bucket = &cache->buckets[entry->hash % cache->num_buckets];
+	entry->hash_next = *bucket;
+	*bucket = entry;
+	entry->lru_prev = NULL;
+	entry->lru_next = cache->lru_head;
+	*(cache->lru_head ? &cache->lru_head->lru_prev : &cache->lru_tail) = entry;
+	cache->lru_head = entry;
+	cache->num_entries++;
+	cache->bytes += bytes;
+}
+
+static void cache_clear(struct statement_cache* cache) {
+	while(cache->lru_head)
+		cache_unlink(cache,cache->lru_head);
+	sqlite3_free(cache->buckets);
+	cache->buckets = NULL;
+	cache->num_buckets = 0;
+	cache->generation++;
+}
+
+enum { TOKEN_END, TOKEN_SPACE, TOKEN_WORD, TOKEN_QUOTED, TOKEN_STRING, TOKEN_NUMBER, TOKEN_PARAM, TOKEN_OTHER };
+
+// splits sql into tokens well enough to find clauses and names within it, returning the length of the token at sql
+static int sql_token(const char* sql, int* type) {
+	const unsigned char* p = (const unsigned char*)sql;
+	int n = 1;
+	if(!*p) {
+		*type = TOKEN_END;
+		return 0;
+	}
+	if(isspace(*p) || (p[0] == '-' && p[1] == '-') || (p[0] == '/' && p[1] == '*')) {
+		*type = TOKEN_SPACE;
+		if(isspace(*p))
+			while(isspace(p[n]))
+				n++;
+		else if(*p == '-')
+			while(p[n] && p[n] != '\n')
+				n++;
+		else {
+			n = 2;
+			while(p[n] && !(p[n] == '*' && p[n+1] == '/'))
+				n++;
+			if(p[n])
+				n += 2;
+		}
+		return n;
+	}
+	if(*p == '\'' || *p == '"' || *p == '`' || *p == '[' || ((*p == 'x' || *p == 'X') && p[1] == '\'')) {
+		*type = *p == '\'' || p[1] == '\'' ? TOKEN_STRING : TOKEN_QUOTED;
+		if(*p != '\'' && *p != '"' && *p != '`' && *p != '[')
+			n++;
+		char close = p[n-1] == '[' ? ']' : p[n-1];
+		for(; p[n]; n++)
+			if(p[n] == close) {
+				if(close == ']' || p[n+1] != close)
+					return n+1;
+				n++; // doubled quote
+			}
+		return n;
+	}
+	if(isdigit(*p) || (*p == '.' && isdigit(p[1]))) {
+		*type = TOKEN_NUMBER;
+		while(isalnum(p[n]) || p[n] == '.' || ((p[n] == '+' || p[n] == '-') && (p[n-1] == 'e' || p[n-1] == 'E')))
+			n++;
+		return n;
+	}
+	if(*p == '?' || *p == ':' || *p == '@' || *p == '$') {
+		*type = TOKEN_PARAM;
+		while(isalnum(p[n]) || p[n] == '_' || p[n] == '$' || p[n] >= 0x80)
+			n++;
+		return n;
+	}
+	if(isalpha(*p) || *p == '_' || *p >= 0x80) {
+		*type = TOKEN_WORD;
+		while(isalnum(p[n]) || p[n] == '_' || p[n] == '$' || p[n] >= 0x80)
+			n++;
+		return n;
+	}
+	*type = TOKEN_OTHER;
+	return n;
+}
+
+// like sql_token but skipping over whitespace and comments
+static const char* sql_next(const char* sql, int* len, int* type) {
+	while((*len = sql_token(sql,type)), *type == TOKEN_SPACE)
+		sql += *len;
+	return sql;
+}
+
+static int token_is(const char* token, int len, const char* word) {
+	return len == (int)strlen(word) && !sqlite3_strnicmp(token,word,len);
+}
+
+// compares an identifier token, quoted or not, to a name
+static int token_names(const char* token, int len, int type, const char* name) {
+	if(type == TOKEN_QUOTED) {
+		token++;
+		len -= 2;
+	}
+	return name && len == (int)strlen(name) && !sqlite3_strnicmp(token,name,len);
+}
+
+// the collating sequence a column compares with if it refers to a table column and sqlite was built with the column
+// metadata to tell; computed columns have no collating sequence of their own unless one is given explicitly,
+// and so compare using BINARY like the columns of the vtab itself
+static const char* column_collation(sqlite3* db, sqlite3_stmt* stmt, int i) {
+	const char* collation = NULL;
+#if !defined(SQLITE_CORE) || defined(SQLITE_ENABLE_COLUMN_METADATA)
+#ifndef SQLITE_CORE
+	if(sqlite3_api->column_table_name)
+#endif
+	{
+		const char* table = sqlite3_column_table_name(stmt,i);
+		if(table && sqlite3_table_column_metadata(db,sqlite3_column_database_name(stmt,i),table,sqlite3_column_origin_name(stmt,i),
+				NULL,&collation,NULL,NULL,NULL) != SQLITE_OK)
+			collation = NULL;
+	}
+#endif
+	return collation ? collation : "BINARY";
+}
+
+// finds the order the statement yields its rows in from the terms of its final top level order by,
+// up to the first term that isn't simply one of its output columns compared using BINARY
+static int find_order(struct statement_vtab* vtab, sqlite3_stmt* stmt) {
+	const char* order = NULL;
+	int depth = 0, len, type;
+	for(const char* p = sql_next(vtab->sql,&len,&type); type != TOKEN_END; p = sql_next(p+len,&len,&type)) {
+		if(type == TOKEN_OTHER && (*p == '(' || *p == ')'))
+			depth += *p == '(' ? 1 : -1;
+		else if(!depth && token_is(p,len,"ORDER"))
+			order = p+len;
+	}
+	if(!order)
+		return SQLITE_OK;
+	order = sql_next(order,&len,&type);
+	if(!token_is(order,len,"BY"))
+		return SQLITE_OK;
+	if(!(vtab->order = sqlite3_malloc64(sizeof(*vtab->order)*vtab->num_outputs)))
+		return SQLITE_NOMEM;
+
+	const char* p = sql_next(order+len,&len,&type);
+	while(vtab->order_len < vtab->num_outputs) {
+		const char* term = p;
+		int term_len = len, term_type = type;
+		int column = -1;
+		if(term_type == TOKEN_NUMBER) {
+			column = atoi(term)-1;
+			if(column >= vtab->num_outputs)
+				column = -1;
+		} else if(term_type == TOKEN_WORD || term_type == TOKEN_QUOTED)
+			for(int i = 0; i < vtab->num_outputs; i++)
+				if(token_names(term,term_len,term_type,sqlite3_column_name(stmt,i)))
+					column = i;
+		if(column < 0 || term_type == TOKEN_END)
+			break;
+
+		p = sql_next(p+len,&len,&type);
+		int binary = !sqlite3_stricmp(column_collation(vtab->db,stmt,column),"BINARY");
+		if(token_is(p,len,"COLLATE")) {
+			p = sql_next(p+len,&len,&type);
+			binary = token_names(p,len,type,"BINARY");
+			p = sql_next(p+len,&len,&type);
+		}
+		int desc = 0;
+		if(token_is(p,len,"ASC") || (desc = token_is(p,len,"DESC")))
+			p = sql_next(p+len,&len,&type);
+		if(token_is(p,len,"NULLS")) {
+			p = sql_next(p+len,&len,&type);
+			if(!token_is(p,len,desc?"LAST":"FIRST"))
+				break;
+			p = sql_next(p+len,&len,&type);
+		}
+		if(!binary)
+			break;
+		vtab->order[vtab->order_len].column = column;
+		vtab->order[vtab->order_len++].desc = desc;
+		if(!(type == TOKEN_OTHER && *p == ','))
+			break;
+		p = sql_next(p+len,&len,&type);
+	}
+	return SQLITE_OK;
+}
+
+static char* build_create_statement(sqlite3_stmt* stmt, int bulk) {
 	sqlite3_str* sql = sqlite3_str_new(NULL);
 	sqlite3_str_appendall(sql,"CREATE TABLE x( ");
 	for(int i = 0, nout = sqlite3_column_count(stmt); i < nout; i++) {
@@ -40,7 +868,9 @@ static char* build_create_statement(sqlite3_stmt* stmt) {
 		const char* type = sqlite3_column_decltype(stmt,i);
 		sqlite3_str_appendf(sql,"%Q %s,",name,(type?type:""));
 	}
-	for(int i = 0, nargs = sqlite3_bind_parameter_count(stmt); i < nargs; i++) {
+	if(bulk)
+		sqlite3_str_appendall(sql,"ordinal INTEGER,tuples hidden,");
+	for(int i = 0, nargs = bulk ? 0 : sqlite3_bind_parameter_count(stmt); i < nargs; i++) {
 		const char* name = sqlite3_bind_parameter_name(stmt,i+1);
 		if(name)
 			sqlite3_str_appendf(sql,"%Q hidden,",name+1);
@@ -52,200 +882,3570 @@ static char* build_create_statement(sqlite3_stmt* stmt) {
 	return sqlite3_str_finish(sql);
 }
 
-static int statement_vtab_destroy(sqlite3_vtab* pVTab){
-	sqlite3_free(((struct statement_vtab*)pVTab)->sql);
-	sqlite3_free(pVTab);
-	return SQLITE_OK;
+// what the declared schema of the vtab depends on: the number of output columns and the parameters by name,
+// then the names and declared types of the output columns
+static char* statement_signature(sqlite3_stmt* stmt) {
+	sqlite3_str* signature = sqlite3_str_new(NULL);
+	int num_inputs = sqlite3_bind_parameter_count(stmt), num_outputs = sqlite3_column_count(stmt);
+	sqlite3_str_appendf(signature,"%d %d",num_outputs,num_inputs);
+	for(int i = 1; i <= num_inputs; i++) {
+		const char* name = sqlite3_bind_parameter_name(stmt,i);
+		sqlite3_str_appendf(signature," %d:%s",name?(int)strlen(name):0,name?name:"");
+	}
+	for(int i = 0; i < num_outputs; i++) {
+		const char* name = sqlite3_column_name(stmt,i);
+		const char* type = sqlite3_column_decltype(stmt,i);
+		if(!name) {
+			sqlite3_free(sqlite3_str_finish(signature));
+			return NULL;
+		}
+		sqlite3_str_appendf(signature," %d:%s %d:%s",(int)strlen(name),name,type?(int)strlen(type):0,type?type:"");
+	}
+	return sqlite3_str_finish(signature);
 }
 
-static int statement_vtab_create(sqlite3* db, void* pAux, int argc, const char* const* argv, sqlite3_vtab** ppVtab, char** pzErr) {
-	size_t len;
-	if(argc < 4 || (len = strlen(argv[3])) < 3) {
-		if(!(*pzErr = sqlite3_mprintf("no statement provided")))
+static int statement_acquire(struct statement_vtab* vtab, int variant, sqlite3_stmt** ppStmt) {
+	struct statement_variant* v = &vtab->program->variants[variant];
+	int ret = SQLITE_OK;
+	if(v->pool_len)
+		*ppStmt = v->pool[--v->pool_len];
+	else {
+		// pooled statements are long lived so keep them out of lookaside
+		vtab->stats.prepares++;
+		ret = sqlite3_prepare_v3(vtab->db,v->sql,v->sql_len,SQLITE_PREPARE_PERSISTENT,ppStmt,NULL);
+	}
+	if(ret != SQLITE_OK || variant || vtab->verified)
+		return ret;
+	// the first statement of a table connected to from its shadow table has to agree with what was declared,
+	// even if it was pooled by another table sharing the program
+	char* signature = statement_signature(*ppStmt);
+	if(!signature)
+		ret = SQLITE_NOMEM;
+	else if(strcmp(signature,vtab->signature)) {
+		sqlite3_free(vtab->base.zErrMsg);
+		vtab->base.zErrMsg = sqlite3_mprintf("statement of %s no longer matches its declared schema, the table must be recreated",vtab->name);
+		ret = SQLITE_SCHEMA;
+	} else
+		vtab->verified = 1;
+	sqlite3_free(signature);
+	if(ret != SQLITE_OK) {
+		sqlite3_finalize(*ppStmt);
+		*ppStmt = NULL;
+	}
+	return ret;
+}
+
+static void statement_release(struct statement_vtab* vtab, int variant, sqlite3_stmt* stmt) {
+	struct statement_variant* v = &vtab->program->variants[variant];
+	for(int i = 0; i < (int)(sizeof(stats_status)/sizeof(*stats_status)); i++)
+		vtab->stats.status[i] += sqlite3_stmt_status(stmt,stats_status[i],1);
+	// pools are shared between tables, each keeping it to its own pool size
+	if(v->pool_len == v->pool_cap && v->pool_len < vtab->pool_max) {
+		sqlite3_stmt** pool = sqlite3_realloc64(v->pool,sizeof(*v->pool)*vtab->pool_max);
+		if(pool) {
+			v->pool = pool;
+			v->pool_cap = vtab->pool_max;
+		}
+	}
+	if(v->pool_len >= v->pool_cap || v->pool_len >= vtab->pool_max) {
+		sqlite3_finalize(stmt);
+		return;
+	}
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+	v->pool[v->pool_len++] = stmt;
+}
+
+static void variant_free(struct statement_variant* v) {
+	while(v->pool_len)
+		sqlite3_finalize(v->pool[--v->pool_len]);
+	sqlite3_free(v->pool);
+	sqlite3_free(v->sql);
+	sqlite3_free(v->key);
+}
+
+// appends sql with whitespace and comments each reduced to a single space, and none at either end
+static void sql_append_key(sqlite3_str* key, const char* sql) {
+	int len, type;
+	for(const char* p = sql; (len = sql_token(p,&type)), type != TOKEN_END; p += len) {
+		if(type != TOKEN_SPACE)
+			sqlite3_str_append(key,p,len);
+		else if(p != sql && p[len])
+			sqlite3_str_appendchar(key,1,' ');
+	}
+}
+
+// finds the program of the connection for this sql or adds one, with a reference for the caller
+static struct statement_program* program_acquire(struct statement_vtab_context* context, const char* sql, size_t sql_len) {
+	sqlite3_str* key = sqlite3_str_new(NULL);
+	sql_append_key(key,sql);
+	int key_len = sqlite3_str_length(key);
+	if(sqlite3_str_errcode(key) != SQLITE_OK) {
+		sqlite3_free(sqlite3_str_finish(key));
+		return NULL;
+	}
+	char* key_sql = sqlite3_str_finish(key); // NULL if there's nothing but whitespace, which won't prepare anyway
+	sqlite3_uint64 hash = hash_bytes(key_sql,key_len);
+	struct statement_program* program;
+	for(program = context->programs; program; program = program->next)
+		if(program->hash == hash && program->key_len == key_len && (!key_len || !memcmp(program->key,key_sql,key_len))) {
+			sqlite3_free(key_sql);
+			program->refs++;
+			return program;
+		}
+
+	if(!(program = sqlite3_malloc64(sizeof(*program)))) {
+		sqlite3_free(key_sql);
+		return NULL;
+	}
+	memset(program,0,sizeof(*program));
+	program->refs = 1;
+	program->hash = hash;
+	program->key = key_sql;
+	program->key_len = key_len;
+	if(!(program->variants = sqlite3_malloc64(sizeof(*program->variants)))) {
+		sqlite3_free(key_sql);
+		sqlite3_free(program);
+		return NULL;
+	}
+	memset(program->variants,0,sizeof(*program->variants));
+	program->num_variants = 1;
+	program->variants[0].valid = 1;
+	program->variants[0].sql_len = (int)sql_len;
+	if(!(program->variants[0].sql = sqlite3_mprintf("%.*s",(int)sql_len,sql))) {
+		sqlite3_free(program->variants);
+		sqlite3_free(key_sql);
+		sqlite3_free(program);
+		return NULL;
+	}
+	program->next = context->programs;
+	context->programs = program;
+	return program;
+}
+
+static void program_unref(struct statement_vtab_context* context, struct statement_program* program) {
+	if(!program || --program->refs)
+		return;
+	struct statement_program** p = &context->programs;
+	while(*p != program)
+		p = &(*p)->next;
+	*p = program->next;
+	for(int i = 0; i < program->num_variants; i++)
+		variant_free(&program->variants[i]);
+	sqlite3_free(program->variants);
+	sqlite3_free(program->order);
+	sqlite3_free(program->key);
+	sqlite3_free(program);
+}
+
+static int option_is(const char* key, size_t key_len, const char* name) {
+	return key_len == strlen(name) && !sqlite3_strnicmp(key,name,key_len);
+}
+
+static int option_real(const char* value, double min, double* out) {
+	char* end;
+	if(!value)
+		return 0;
+	*out = strtod(value,&end);
+	while(isspace((unsigned char)*end))
+		end++;
+	return end != value && !*end && *out >= min;
+}
+
+static int option_int(const char* value, sqlite3_int64 min, sqlite3_int64* out) {
+	char* end;
+	if(!value)
+		return 0;
+	*out = strtoll(value,&end,10);
+	while(isspace((unsigned char)*end))
+		end++;
+	return end != value && !*end && *out >= min;
+}
+
+// any arguments following the statement are options of the form key or key=value
+static int parse_options(struct statement_vtab* vtab, int argc, const char* const* argv, char** pzErr) {
+	int has_cache_option = 0; // cache_bytes=0 turns off the cache of deterministic tables
+	for(int i = 4; i < argc; i++) {
+		const char* key = argv[i];
+		const char* value = strchr(key,'=');
+		size_t key_len = value ? (size_t)(value-key) : strlen(key);
+		while(key_len && isspace((unsigned char)key[key_len-1]))
+			key_len--;
+		if(value)
+			while(isspace((unsigned char)*++value));
+
+		sqlite3_int64 n;
+		double r;
+		if(option_is(key,key_len,"cost")) {
+			if(!option_real(value,0,&r))
+				goto bad_value;
+			vtab->cost = r;
+			vtab->cost_given = 1;
+		} else if(option_is(key,key_len,"rows")) {
+			if(!option_int(value,0,&n))
+				goto bad_value;
+			vtab->rows = n;
+			vtab->rows_given = 1;
+		} else if(option_is(key,key_len,"unique")) {
+			if(value)
+				goto bad_value;
+			vtab->unique = 1;
+		} else if(option_is(key,key_len,"pool")) {
+			if(!option_int(value,0,&n) || n > 0x10000)
+				goto bad_value;
+			vtab->pool_max = (int)n;
+		} else if(option_is(key,key_len,"prefetch")) {
+			if(!option_int(value,0,&n) || n > 0x10000)
+				goto bad_value;
+			vtab->prefetch = (int)n;
+		} else if(option_is(key,key_len,"cache_bytes")) {
+			if(!option_int(value,0,&n))
+				goto bad_value;
+			vtab->cache.max_bytes = n;
+			has_cache_option = 1;
+		} else if(option_is(key,key_len,"materialize")) {
+			if(value && sqlite3_stricmp(value,"incremental"))
+				goto bad_value;
+			vtab->materialize = 1;
+			vtab->incremental = value != NULL;
+		} else if(option_is(key,key_len,"parallel")) {
+			if(!option_int(value,1,&n) || n > 64)
+				goto bad_value;
+			vtab->parallel = (int)n;
+		} else if(option_is(key,key_len,"bulk")) {
+			if(value)
+				goto bad_value;
+			vtab->bulk = 1;
+		} else if(option_is(key,key_len,"deterministic")) {
+			if(value)
+				goto bad_value;
+			vtab->deterministic = 1;
+		} else if(option_is(key,key_len,"innocuous")) {
+			if(value)
+				goto bad_value;
+			vtab->innocuous = 1;
+		} else if(option_is(key,key_len,"registry")) {
+			if(value)
+				goto bad_value;
+			vtab->registry = 1;
+		} else if(option_is(key,key_len,"feedback")) {
+			if(value && (!option_int(value,1,&n) || n > 0x10000))
+				goto bad_value;
+			vtab->feedback = value ? (int)n : STATEMENT_VTAB_FEEDBACK_RUNS;
+		} else if(option_is(key,key_len,"slow_ms")) {
+			if(!option_real(value,0,&r) || r > 1e9)
+				goto bad_value;
+			vtab->slow_ns = (sqlite3_int64)(r*1e6);
+		} else if(option_is(key,key_len,"cache_shared")) {
+			if(value)
+				goto bad_value;
+			vtab->cache_shared = 1;
+		} else if(option_is(key,key_len,"budget_steps")) {
+			if(!option_int(value,1,&n))
+				goto bad_value;
+			vtab->budget_steps = n;
+		} else if(option_is(key,key_len,"budget_ms")) {
+			if(!option_real(value,0,&r) || r > 1e9 || (sqlite3_int64)(r*1e6) < 1)
+				goto bad_value;
+			vtab->budget_ns = (sqlite3_int64)(r*1e6);
+		} else if(option_is(key,key_len,"budget_truncate")) {
+			if(value)
+				goto bad_value;
+			vtab->budget_truncate = 1;
+		} else if(option_is(key,key_len,"inline")) {
+			if(value)
+				goto bad_value;
+			vtab->inline_tables = 1;
+		} else if(option_is(key,key_len,"function")) {
+			if(value && !*value)
+				goto bad_value;
+			sqlite3_free(vtab->function);
+			if(!(vtab->function = sqlite3_mprintf("%s",value ? value : vtab->name)))
+				return SQLITE_NOMEM;
+		} else {
+			if(!(*pzErr = sqlite3_mprintf("unknown option \"%.*s\"",(int)key_len,key)))
+				return SQLITE_NOMEM;
+			return SQLITE_MISUSE;
+		}
+		continue;
+	bad_value:
+		if(!(*pzErr = sqlite3_mprintf("invalid value for option \"%.*s\"",(int)key_len,key)))
 			return SQLITE_NOMEM;
 		return SQLITE_MISUSE;
 	}
-	if(argv[3][0] != '(' || argv[3][len-1] != ')') {
-		if(!(*pzErr = sqlite3_mprintf("statement must be parenthesized")))
+	if(vtab->materialize && !vtab->cache.max_bytes)
+		vtab->cache.max_bytes = STATEMENT_VTAB_MATERIALIZE_BYTES;
+	// bulk tables run the statement for many parameters at once, which the cache doesn't apply to
+	if(vtab->deterministic && !vtab->cache.max_bytes && !has_cache_option && !vtab->bulk)
+		vtab->cache.max_bytes = STATEMENT_VTAB_DETERMINISTIC_BYTES;
+	if(vtab->bulk && vtab->cache.max_bytes) {
+		if(!(*pzErr = sqlite3_mprintf("bulk can't be combined with cache_bytes or materialize")))
+			return SQLITE_NOMEM;
+		return SQLITE_MISUSE;
+	}
+	if(vtab->cache_shared && (!vtab->cache.max_bytes || vtab->materialize)) {
+		if(!(*pzErr = sqlite3_mprintf("cache_shared needs cache_bytes or deterministic, and can't be combined with materialize")))
+			return SQLITE_NOMEM;
+		return SQLITE_MISUSE;
+	}
+	if(vtab->budget_truncate && !vtab->budget_steps && !vtab->budget_ns) {
+		if(!(*pzErr = sqlite3_mprintf("budget_truncate needs budget_steps or budget_ms")))
 			return SQLITE_NOMEM;
 		return SQLITE_MISUSE;
 	}
+	return SQLITE_OK;
+}
 
-	int ret;
-	sqlite3_mutex* mutex = sqlite3_db_mutex(db); // only needed to ensure correctness of sqlite3_errmsg
-	sqlite3_stmt* stmt = NULL;
-	char* create = NULL;
+// budgets take over the progress handler, which needs the application's to have been set through the extension
+// for it to be put back. tables with a budget fail otherwise, rather than clobbering the handler or going unchecked
+static int budget_usable(struct statement_vtab* vtab, char** pzErr) {
+	if(vtab->context->progress_set)
+		return SQLITE_OK;
+	if(!(*pzErr = sqlite3_mprintf("budget_steps and budget_ms need the progress handler set with sqlite3_statementvtab_progress_handler")))
+		return SQLITE_NOMEM;
+	return SQLITE_MISUSE;
+}
 
-	struct statement_vtab* vtab = sqlite3_malloc64(sizeof(*vtab));
-	if(!vtab)
+// appends the query plan of sql, a line per step indented by depth as the shell shows it or separated by "; " if not
+// multiline, flagging the full scans of tables and automatic indexes that usually explain a slow statement.
+// scans of subqueries and common table expressions are told apart by the co-routine or materialization before them
+static int plan_describe(sqlite3* db, const char* sql, sqlite3_str* out, int multiline) {
+	char* explain = sqlite3_mprintf("EXPLAIN QUERY PLAN %s",sql);
+	if(!explain)
 		return SQLITE_NOMEM;
-	memset(vtab,0,sizeof(*vtab));
-	*ppVtab = &vtab->base;
+	sqlite3_stmt* stmt;
+	int ret = sqlite3_prepare_v2(db,explain,-1,&stmt,NULL);
+	sqlite3_free(explain);
+	if(ret != SQLITE_OK)
+		return ret;
+
+	int parents[64], depth = 0, lines = 0; // ids of the steps enclosing the current one
+	sqlite3_str* inner = sqlite3_str_new(db); // names of the subqueries, each followed by a newline
+	sqlite3_str_appendchar(inner,1,'\n');
+	while((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+		int id = sqlite3_column_int(stmt,0), parent = sqlite3_column_int(stmt,1);
+		const char* detail = (const char*)sqlite3_column_text(stmt,3);
+		if(!detail)
+			continue;
+		while(depth && parents[depth-1] != parent)
+			depth--;
+		if(lines++)
+			sqlite3_str_appendall(out,multiline ? "\n" : "; ");
+		if(multiline)
+			sqlite3_str_appendchar(out,2*depth,' ');
+		sqlite3_str_appendall(out,detail);
+		if(!strncmp(detail,"CO-ROUTINE ",11))
+			sqlite3_str_appendf(inner,"%s\n",detail+11);
+		else if(!strncmp(detail,"MATERIALIZE ",12))
+			sqlite3_str_appendf(inner,"%s\n",detail+12);
+		if(strstr(detail,"AUTOMATIC"))
+			sqlite3_str_appendall(out," <-- automatic index");
+		else if(!strncmp(detail,"SCAN ",5) && strncmp(detail,"SCAN CONSTANT ROW",17) && !strstr(detail,"VIRTUAL TABLE")
+			&& strncmp(detail,"SCAN (subquery",14) && !strstr(detail,"-ROW VALUES")) {
+			// the name scanned, up to where the index it's scanned by is given if any
+			const char* name = detail+5;
+			const char* end = strchr(name,' ');
+			int name_len = end ? (int)(end-name) : (int)strlen(name);
+			const char* names = sqlite3_str_value(inner);
+			int is_table = 1;
+			for(const char* p = names; p && (p = strstr(p,"\n")) && p[1]; p++)
+				if(!strncmp(p+1,name,name_len) && p[1+name_len] == '\n')
+					is_table = 0;
+			if(is_table)
+				sqlite3_str_appendall(out," <-- full scan");
+		}
+		if(depth < (int)(sizeof(parents)/sizeof(*parents)))
+			parents[depth++] = id;
+	}
+	sqlite3_finalize(stmt);
+	int inner_ret = sqlite3_str_errcode(inner);
+	sqlite3_free(sqlite3_str_finish(inner));
+	if(ret == SQLITE_DONE && inner_ret != SQLITE_OK)
+		return inner_ret;
+	return ret == SQLITE_DONE ? sqlite3_str_errcode(out) : ret;
+}
+
+// rows produced by one loop of the query plan as described by EXPLAIN QUERY PLAN
+
+static double plan_loop_rows(const char* detail) {
+	int n;
+	if(!strncmp(detail,"SCAN CONSTANT ROW",17))
+		return 1;
+	if(sscanf(detail,"SCAN %d-ROW VALUES",&n) == 1)
+		return n;
+	if(strstr(detail,"VIRTUAL TABLE"))
+		return STATEMENT_VTAB_VTAB_ROWS;
+	if(!strncmp(detail,"SCAN ",5))
+		return STATEMENT_VTAB_TABLE_ROWS;
+	if(strstr(detail,"(rowid=?)"))
+		return 1;
+	if(strchr(detail,'<') || strchr(detail,'>'))
+		return STATEMENT_VTAB_RANGE_ROWS;
+	return STATEMENT_VTAB_EQ_ROWS;
+}
+
+// the loops at the top level of the plan are nested so their row counts multiply, anything else
+// (subqueries, compound arms, automatic indexes) is taken to run once and just adds to the cost
+static int estimate_plan(sqlite3* db, const char* sql, double* cost, sqlite3_int64* rows, int* sorted) {
+	char* explain = sqlite3_mprintf("EXPLAIN QUERY PLAN %s",sql);
+	if(!explain)
+		return SQLITE_NOMEM;
+	sqlite3_stmt* stmt;
+	int ret = sqlite3_prepare_v2(db,explain,-1,&stmt,NULL);
+	sqlite3_free(explain);
+	if(ret != SQLITE_OK)
+		return ret;
+
+	double nested = 1, other = 0, largest = 1;
+	int sorts = 0, loops = 0;
+	while((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+		const char* detail = (const char*)sqlite3_column_text(stmt,3);
+		if(!detail)
+			continue;
+		if(!strncmp(detail,"USE TEMP B-TREE",15)) {
+			sorts++;
+			// sorting the entire output, as opposed to only part of it
+			if(sorted && !strcmp(detail,"USE TEMP B-TREE FOR ORDER BY"))
+				*sorted = 1;
+			continue;
+		}
+		if(strncmp(detail,"SCAN ",5) && strncmp(detail,"SEARCH ",7))
+			continue;
+		double n = plan_loop_rows(detail);
+		if(n > largest)
+			largest = n;
+		if(sqlite3_column_int(stmt,1) == 0) {
+			nested *= n;
+			loops++;
+		} else
+			other += n;
+	}
+	sqlite3_finalize(stmt);
+	if(ret != SQLITE_DONE)
+		return ret;
+
+	double n = loops ? nested : largest;
+	*rows = n < 1e18 ? (sqlite3_int64)n : (sqlite3_int64)1e18;
+	*cost = n + other;
+	for(int i = 0; i < sorts; i++) // roughly n log n for each sort
+		for(double m = n; m > 1; m /= 2)
+			*cost += n;
+	return SQLITE_OK;
+}
+
+// a statement yields at most one row if it has a single ResultRow that no loop leads back to:
+// every loop closes with a jump from after its body back to its start, so that's what to look for
+// between the ResultRow and the one-time initialization code Init jumps to at the end of the program.
+// subroutines and coroutines make control flow harder to follow so these are assumed to loop
+static int at_most_one_row(sqlite3* db, const char* sql, int* unique) {
+	char* explain = sqlite3_mprintf("EXPLAIN %s",sql);
+	if(!explain)
+		return SQLITE_NOMEM;
+	sqlite3_stmt* stmt;
+	int ret = sqlite3_prepare_v2(db,explain,-1,&stmt,NULL);
+	sqlite3_free(explain);
+	if(ret != SQLITE_OK)
+		return ret;
+
+	int result_rows = 0, result_addr = -1, init_target = -1, loops = 0;
+	while((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+		int addr = sqlite3_column_int(stmt,0);
+		const char* op = (const char*)sqlite3_column_text(stmt,1);
+		int p2 = sqlite3_column_int(stmt,3);
+		if(!op)
+			continue;
+		if(!strcmp(op,"Init"))
+			init_target = p2;
+		else if(!strcmp(op,"ResultRow")) {
+			result_rows++;
+			result_addr = addr;
+		} else if(!strcmp(op,"Gosub") || !strcmp(op,"Return") || !strcmp(op,"Yield") || !strcmp(op,"InitCoroutine") || !strcmp(op,"Jump"))
+			loops++;
+		else if(result_rows && addr > result_addr && (init_target < 0 || addr < init_target) && p2 > 0 && p2 <= result_addr
+			&& strcmp(op,"Halt") && strcmp(op,"Close"))
+			loops++;
+	}
+	sqlite3_finalize(stmt);
+	if(ret != SQLITE_DONE)
+		return ret;
+	*unique = result_rows == 1 && !loops;
+	return SQLITE_OK;
+}
+
+static void registered_unref(struct statement_registered* entry) {
+	sqlite3_mutex* mutex = registry_mutex();
+	sqlite3_mutex_enter(mutex);
+	int refs = --entry->refs;
+	sqlite3_mutex_leave(mutex);
+	if(refs)
+		return;
+	sqlite3_free(entry->key);
+	sqlite3_free(entry->sql);
+	sqlite3_free(entry->signature);
+	sqlite3_free(entry->declaration);
+	sqlite3_free(entry->order);
+	sqlite3_free(entry);
+}
+
+// the key of a table in the registry, NULL without a file to share it by such as for temp or in-memory databases
+static char* registry_key(struct statement_vtab* vtab, size_t* key_len) {
+	const char* filename = sqlite3_db_filename(vtab->db,vtab->schema);
+	if(!filename || !*filename)
+		return NULL;
+	size_t filename_len = strlen(filename), name_len = strlen(vtab->name);
+	char* key = sqlite3_malloc64(filename_len+name_len+2);
+	if(!key)
+		return NULL;
+	memcpy(key,filename,filename_len+1);
+	memcpy(key+filename_len+1,vtab->name,name_len+1);
+	*key_len = filename_len+name_len+1;
+	return key;
+}
+
+// the schema cookie of the table's database, which changes along with the tables its statement might read
+static int schema_cookie(struct statement_vtab* vtab, int* schema_version) {
+	char* sql = sqlite3_mprintf("PRAGMA \"%w\".schema_version",vtab->schema);
+	if(!sql)
+		return SQLITE_NOMEM;
+	sqlite3_stmt* stmt = NULL;
+	int ret = sqlite3_prepare_v2(vtab->db,sql,-1,&stmt,NULL);
+	sqlite3_free(sql);
+	if(ret == SQLITE_OK && (ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+		*schema_version = sqlite3_column_int(stmt,0);
+		ret = SQLITE_OK;
+	}
+	sqlite3_finalize(stmt);
+	return ret;
+}
+
+// takes the entry out of the registry, for it to be freed once the last table using it lets go
+static void registry_remove(struct statement_vtab* vtab) {
+	size_t key_len;
+	char* key = registry_key(vtab,&key_len);
+	if(!key)
+		return;
+	sqlite3_mutex* mutex = registry_mutex();
+	struct statement_registered* entry = NULL;
+	sqlite3_mutex_enter(mutex);
+	for(struct statement_registered** p = &registry; *p; p = &(*p)->next)
+		if((*p)->key_len == key_len && !memcmp((*p)->key,key,key_len)) {
+			entry = *p;
+			*p = entry->next;
+			break;
+		}
+	sqlite3_mutex_leave(mutex);
+	sqlite3_free(key);
+	if(entry)
+		registered_unref(entry);
+}
+
+// connects the table to what the registry has for it, leaving *declaration unset if there's nothing that applies.
+// what's there only applies to the same statement as of the same schema cookie
+static int registry_attach(struct statement_vtab* vtab, char** declaration) {
+	size_t key_len;
+	char* key = registry_key(vtab,&key_len);
+	int schema_version = 0, ret;
+	*declaration = NULL;
+	if(!key)
+		return SQLITE_OK;
+	if((ret = schema_cookie(vtab,&schema_version)) != SQLITE_OK) {
+		sqlite3_free(key);
+		return ret == SQLITE_NOMEM ? ret : SQLITE_OK;
+	}
+	sqlite3_mutex* mutex = registry_mutex();
+	struct statement_registered* entry;
+	sqlite3_mutex_enter(mutex);
+	for(entry = registry; entry; entry = entry->next)
+		if(entry->key_len == key_len && !memcmp(entry->key,key,key_len)) {
+			if(entry->schema_version == schema_version && entry->sql_len == vtab->sql_len && !memcmp(entry->sql,vtab->sql,vtab->sql_len))
+				entry->refs++;
+			else
+				entry = NULL;
+			break;
+		}
+	sqlite3_mutex_leave(mutex);
+	sqlite3_free(key);
+	if(!entry)
+		return SQLITE_OK;
+	if(!(*declaration = sqlite3_mprintf("%s",entry->declaration))) {
+		registered_unref(entry);
+		return SQLITE_NOMEM;
+	}
+	vtab->registered = entry;
+	vtab->signature = entry->signature;
+	vtab->order = entry->order;
+	vtab->order_len = entry->order_len;
+	vtab->num_inputs = entry->num_inputs;
+	vtab->num_outputs = entry->num_outputs;
+	vtab->cost = entry->cost;
+	vtab->rows = entry->rows;
+	vtab->unique = entry->unique;
+	vtab->program->variants[0].sorted = entry->sorted;
+	return SQLITE_OK;
+}
+
+// puts what was derived for the table in the registry for other connections, in place of anything kept before
+static int registry_publish(struct statement_vtab* vtab, const char* declaration) {
+	struct statement_registered* entry = sqlite3_malloc64(sizeof(*entry));
+	if(!entry)
+		return SQLITE_NOMEM;
+	memset(entry,0,sizeof(*entry));
+	entry->refs = 1;
+	if(!(entry->key = registry_key(vtab,&entry->key_len))) {
+		sqlite3_free(entry);
+		return SQLITE_OK; // nothing to share by, or no memory to tell, neither of which keeps the table from working
+	}
+	int ret = schema_cookie(vtab,&entry->schema_version);
+	if(ret != SQLITE_OK) {
+		registered_unref(entry);
+		return ret == SQLITE_NOMEM ? ret : SQLITE_OK;
+	}
+	entry->sql_len = vtab->sql_len;
+	entry->num_inputs = vtab->num_inputs;
+	entry->num_outputs = vtab->num_outputs;
+	entry->cost = vtab->cost;
+	entry->rows = vtab->rows;
+	entry->unique = vtab->unique;
+	entry->sorted = vtab->program->variants[0].sorted;
+	entry->order_len = vtab->order_len;
+	if(!(entry->sql = sqlite3_mprintf("%.*s",(int)vtab->sql_len,vtab->sql)) || !(entry->signature = sqlite3_mprintf("%s",vtab->signature))
+		|| !(entry->declaration = sqlite3_mprintf("%s",declaration))
+		|| (vtab->order_len && !(entry->order = sqlite3_malloc64(sizeof(*entry->order)*vtab->order_len)))) {
+		registered_unref(entry);
+		return SQLITE_NOMEM;
+	}
+	if(vtab->order_len)
+		memcpy(entry->order,vtab->order,sizeof(*entry->order)*vtab->order_len);
+	registry_remove(vtab);
+	sqlite3_mutex* mutex = registry_mutex();
+	sqlite3_mutex_enter(mutex);
+	entry->next = registry;
+	registry = entry;
+	sqlite3_mutex_leave(mutex);
+	return SQLITE_OK;
+}
+
+// under the registry mutex
+static void shared_file_unref(struct statement_shared_file* file) {
+	if(--file->refs)
+		return;
+	struct statement_shared_file** p = &shared_files;
+	while(*p != file)
+		p = &(*p)->next;
+	*p = file->next;
+	sqlite3_mutex_free(file->mutex);
+	sqlite3_free(file->name);
+	sqlite3_free(file);
+}
+
+// finds or adds the file of the table's database, and sets up the shared cache if it isn't yet
+static int shared_setup(struct statement_vtab* vtab) {
+	const char* filename = sqlite3_db_filename(vtab->db,vtab->schema);
+	if(!filename || !*filename)
+		return SQLITE_OK;
+	int ret = SQLITE_OK;
+	sqlite3_mutex* mutex = registry_mutex();
+	sqlite3_mutex_enter(mutex);
+	struct statement_shared_file* file;
+	for(file = shared_files; file && strcmp(file->name,filename); file = file->next);
+	if(file)
+		file->refs++;
+	else if((file = sqlite3_malloc64(sizeof(*file)))) {
+		memset(file,0,sizeof(*file));
+		file->refs = 1;
+		if(!(file->name = sqlite3_mprintf("%s",filename)) || (!(file->mutex = sqlite3_mutex_alloc(SQLITE_MUTEX_FAST)) && sqlite3_threadsafe())) {
+			sqlite3_free(file->name);
+			sqlite3_free(file);
+			file = NULL;
+		} else {
+			file->next = shared_files;
+			shared_files = file;
+		}
+	}
+	if(!file)
+		ret = SQLITE_NOMEM;
+	for(int i = 0; i < STATEMENT_VTAB_SHARED_SHARDS && !shared_users && ret == SQLITE_OK; i++) {
+		// the shard is held while entries unreferenced by evicting them are freed
+		if(!(shards[i].mutex = sqlite3_mutex_alloc(SQLITE_MUTEX_RECURSIVE)) && sqlite3_threadsafe()) {
+			while(i--)
+				sqlite3_mutex_free(shards[i].mutex);
+			ret = SQLITE_NOMEM;
+			break;
+		}
+		shards[i].cache.max_bytes = STATEMENT_VTAB_SHARED_BYTES/STATEMENT_VTAB_SHARED_SHARDS;
+	}
+	if(ret == SQLITE_OK) {
+		shared_users++;
+		vtab->shared_file = file;
+	} else if(file)
+		shared_file_unref(file);
+	sqlite3_mutex_leave(mutex);
+	return ret;
+}
+
+static void shared_release(struct statement_vtab* vtab) {
+	if(!vtab->shared_file)
+		return;
+	sqlite3_mutex* mutex = registry_mutex();
+	sqlite3_mutex_enter(mutex);
+	shared_file_unref(vtab->shared_file);
+	// the cursors of the last table are closed by now, leaving the entries with just the reference of the cache
+	if(!--shared_users)
+		for(int i = 0; i < STATEMENT_VTAB_SHARED_SHARDS; i++) {
+			cache_clear(&shards[i].cache);
+			sqlite3_mutex_free(shards[i].mutex);
+			memset(&shards[i],0,sizeof(shards[i]));
+		}
+	sqlite3_mutex_leave(mutex);
+	vtab->shared_file = NULL;
+}
+
+// moves the generation of the file on, for the results kept before to no longer be found
+static void shared_changed(struct statement_shared_file* file) {
+	sqlite3_mutex_enter(file->mutex);
+	file->generation++;
+	sqlite3_mutex_leave(file->mutex);
+}
+
+// the key of the shared cache, which is the database file as of its generation unless the table is deterministic and
+// the statement as run, the way the key of the program has it, with the parameters in key following the number the
+// connection gave its variant
+static char* shared_key(struct statement_vtab* vtab, int idxNum, char* key, int* key_len) {
+	struct statement_program* program = vtab->program;
+	struct statement_variant* variant = &program->variants[idxNum];
+	// the others wrap the statement as the first of the tables gave it
+	if(idxNum && !variant->key) {
+		sqlite3_str* sql = sqlite3_str_new(NULL);
+		sql_append_key(sql,variant->sql);
+		variant->key_len = sqlite3_str_length(sql);
+		if(!(variant->key = sqlite3_str_finish(sql))) {
+			sqlite3_free(key);
+			return NULL;
+		}
+	}
+	struct statement_shared_file* file = vtab->shared_file;
+	sqlite3_str* shared = sqlite3_str_new(NULL);
+	sqlite3_str_appendall(shared,file->name);
+	sqlite3_str_append(shared,"",1);
+	// the generation, which the promise of deterministic tables makes unnecessary
+	if(!vtab->deterministic) {
+		sqlite3_mutex_enter(file->mutex);
+		sqlite3_uint64 generation = file->generation;
+		sqlite3_mutex_leave(file->mutex);
+		sqlite3_str_appendf(shared,"%llu",generation);
+	}
+	sqlite3_str_append(shared,"",1);
+	if(idxNum)
+		sqlite3_str_append(shared,variant->key,variant->key_len);
+	else
+		sqlite3_str_append(shared,program->key,program->key_len);
+	sqlite3_str_append(shared,"",1);
+	sqlite3_str_append(shared,key+sizeof(idxNum),*key_len-(int)sizeof(idxNum));
+	sqlite3_free(key);
+	*key_len = sqlite3_str_length(shared);
+	if(sqlite3_str_errcode(shared)) {
+		sqlite3_free(sqlite3_str_finish(shared));
+		return NULL;
+	}
+	return sqlite3_str_finish(shared);
+}
+
+static void delta_free(struct statement_delta* delta) {
+	if(!delta)
+		return;
+	sqlite3_finalize(delta->row_stmt);
+	cache_entry_unref(delta->entry);
+	sqlite3_free(delta->slots);
+	sqlite3_free(delta->keys);
+	sqlite3_free(delta->others);
+	sqlite3_free(delta->keyed_sql);
+	sqlite3_free(delta->schema);
+	sqlite3_free(delta->table);
+	sqlite3_free(delta);
+}
+
+static int statement_vtab_destroy(sqlite3_vtab* pVTab){
+	struct statement_vtab* vtab = (struct statement_vtab*)pVTab;
+	if(vtab->prev)
+		vtab->prev->next = vtab->next;
+	else if(vtab->context && vtab->context->vtabs == vtab)
+		vtab->context->vtabs = vtab->next;
+	if(vtab->next)
+		vtab->next->prev = vtab->prev;
+	for(struct statement_function* function = vtab->context ? vtab->context->functions : NULL; function; function = function->next)
+		if(function->vtab == vtab) {
+			sqlite3_finalize(function->stmt);
+			function->stmt = NULL;
+			function->vtab = NULL;
+		}
+	for(int i = 0; i < vtab->num_colmaps; i++)
+		sqlite3_free(vtab->colmaps[i]);
+	sqlite3_free(vtab->colmaps);
+	for(int i = 0; i < vtab->num_workers; i++) {
+		for(int j = 0; j < vtab->workers[i].num_stmts; j++)
+			sqlite3_finalize(vtab->workers[i].stmts[j]);
+		sqlite3_free(vtab->workers[i].stmts);
+		sqlite3_close(vtab->workers[i].db);
+	}
+	sqlite3_free(vtab->workers);
+	if(vtab->registered) // whose signature and order these are
+		registered_unref(vtab->registered);
+	else {
+		sqlite3_free(vtab->order);
+		sqlite3_free(vtab->signature);
+	}
+	sqlite3_free(vtab->observed);
+	cache_clear(&vtab->cache);
+	shared_release(vtab);
+	delta_free(vtab->delta);
+	if(!vtab->program || vtab->sql != vtab->program->variants[0].sql)
+		sqlite3_free(vtab->sql);
+	if(vtab->context)
+		program_unref(vtab->context,vtab->program);
+	sqlite3_free(vtab->schema);
+	sqlite3_free(vtab->name);
+	sqlite3_free(vtab->function);
+	sqlite3_free(vtab->data_versions);
+	sqlite3_free(pVTab);
+	return SQLITE_OK;
+}
+
+// the shadow table <name>_schema keeps what was derived from the statement when the table was created, along with
+// the schema cookie of the database as of then, so that connecting to it later needn't prepare and analyse the statement
+#define STATEMENT_VTAB_SHADOW_COLUMNS "sql, signature, declaration, cost, rows, is_unique, sorted, ordering, schema_version"
+
+static int shadow_store(struct statement_vtab* vtab, const char* declaration) {
+	char* sql = sqlite3_mprintf("CREATE TABLE \"%w\".\"%w_schema\"(" STATEMENT_VTAB_SHADOW_COLUMNS ")",vtab->schema,vtab->name);
+	if(!sql)
+		return SQLITE_NOMEM;
+	int ret = sqlite3_exec(vtab->db,sql,NULL,NULL,NULL);
+	sqlite3_free(sql);
+	if(ret != SQLITE_OK)
+		return ret;
+	// creating the shadow table is the last change to the schema the table makes
+	int schema_version;
+	if((ret = schema_cookie(vtab,&schema_version)) != SQLITE_OK)
+		return ret;
+	if(!(sql = sqlite3_mprintf("INSERT INTO \"%w\".\"%w_schema\" VALUES(?,?,?,?,?,?,?,?,?)",vtab->schema,vtab->name)))
+		return SQLITE_NOMEM;
+	sqlite3_stmt* stmt = NULL;
+	ret = sqlite3_prepare_v2(vtab->db,sql,-1,&stmt,NULL);
+	sqlite3_free(sql);
+	if(ret != SQLITE_OK)
+		return ret;
+
+	sqlite3_str* ordering = sqlite3_str_new(NULL);
+	for(int i = 0; i < vtab->order_len; i++)
+		sqlite3_str_appendf(ordering,"%s%d %d",i?",":"",vtab->order[i].column,vtab->order[i].desc);
+	sqlite3_bind_text(stmt,1,vtab->sql,vtab->sql_len,SQLITE_STATIC);
+	sqlite3_bind_text(stmt,2,vtab->signature,-1,SQLITE_STATIC);
+	sqlite3_bind_text(stmt,3,declaration,-1,SQLITE_STATIC);
+	sqlite3_bind_double(stmt,4,vtab->cost);
+	sqlite3_bind_int64(stmt,5,vtab->rows);
+	sqlite3_bind_int(stmt,6,vtab->unique);
+	sqlite3_bind_int(stmt,7,vtab->program->variants[0].sorted);
+	sqlite3_bind_int(stmt,9,schema_version);
+	if((ret = sqlite3_str_errcode(ordering)) == SQLITE_OK) {
+		sqlite3_bind_text(stmt,8,sqlite3_str_value(ordering),sqlite3_str_length(ordering),SQLITE_STATIC);
+		sqlite3_step(stmt);
+		ret = sqlite3_finalize(stmt);
+	} else
+		sqlite3_finalize(stmt);
+	sqlite3_free(sqlite3_str_finish(ordering));
+	return ret;
+}
+
+// loads what shadow_store kept, leaving *declaration unset if there's nothing usable to go by, as is the case for
+// tables created before the shadow table was introduced, with current set if the schema cookie is still the same
+static int shadow_load(struct statement_vtab* vtab, char** declaration, int* current) {
+	*declaration = NULL;
+	*current = 0;
+	int schema_version;
+	int ret = schema_cookie(vtab,&schema_version);
+	if(ret != SQLITE_OK)
+		return ret == SQLITE_NOMEM ? ret : SQLITE_OK;
+	char* sql = sqlite3_mprintf("SELECT " STATEMENT_VTAB_SHADOW_COLUMNS " FROM \"%w\".\"%w_schema\"",vtab->schema,vtab->name);
+	if(!sql)
+		return SQLITE_NOMEM;
+	sqlite3_stmt* stmt = NULL;
+	ret = sqlite3_prepare_v2(vtab->db,sql,-1,&stmt,NULL);
+	sqlite3_free(sql);
+	if(ret == SQLITE_NOMEM)
+		return ret;
+	if(ret != SQLITE_OK || sqlite3_step(stmt) != SQLITE_ROW || sqlite3_column_bytes(stmt,0) != (int)vtab->sql_len
+		|| memcmp(sqlite3_column_text(stmt,0),vtab->sql,vtab->sql_len) || sqlite3_column_type(stmt,2) != SQLITE_TEXT
+		|| sscanf((const char*)sqlite3_column_text(stmt,1),"%d %d",&vtab->num_outputs,&vtab->num_inputs) != 2)
+		return sqlite3_finalize(stmt) == SQLITE_NOMEM ? SQLITE_NOMEM : SQLITE_OK;
+
+	const char* ordering = (const char*)sqlite3_column_text(stmt,7);
+	if(ordering && *ordering && !(vtab->order = sqlite3_malloc64(sizeof(*vtab->order)*vtab->num_outputs))) {
+		sqlite3_finalize(stmt);
+		return SQLITE_NOMEM;
+	}
+	for(char* end; ordering && *ordering && vtab->order_len < vtab->num_outputs; ordering = *end ? end+1 : end) {
+		vtab->order[vtab->order_len].column = (int)strtol(ordering,&end,10);
+		vtab->order[vtab->order_len].desc = (int)strtol(end,&end,10);
+		if(vtab->order[vtab->order_len].column < 0 || vtab->order[vtab->order_len].column >= vtab->num_outputs)
+			break;
+		vtab->order_len++;
+	}
+	vtab->cost = sqlite3_column_double(stmt,3);
+	vtab->rows = sqlite3_column_int64(stmt,4);
+	vtab->unique = sqlite3_column_int(stmt,5);
+	vtab->program->variants[0].sorted = sqlite3_column_int(stmt,6);
+	*current = sqlite3_column_type(stmt,8) == SQLITE_INTEGER && sqlite3_column_int(stmt,8) == schema_version;
+	if(!(vtab->signature = sqlite3_mprintf("%s",sqlite3_column_text(stmt,1))) || !(*declaration = sqlite3_mprintf("%s",sqlite3_column_text(stmt,2)))) {
+		sqlite3_finalize(stmt);
+		return SQLITE_NOMEM;
+	}
+	return sqlite3_finalize(stmt);
+}
+
+// the inline option flattens statement tables called as table-valued functions in the from clause into subqueries
+
+// words ending the list of tables of a from clause, which a join starts again
+static const char* const from_end_words[] = {"WHERE","GROUP","ORDER","LIMIT","HAVING","WINDOW","UNION","INTERSECT","EXCEPT","ON","USING",
+	"SELECT","VALUES",NULL};
+// words that may follow a table in the from clause which aren't its alias
+static const char* const join_words[] = {"WHERE","GROUP","ORDER","LIMIT","HAVING","WINDOW","UNION","INTERSECT","EXCEPT","ON","USING",
+	"JOIN","LEFT","RIGHT","FULL","INNER","CROSS","NATURAL","OUTER",NULL};
+// words allowed in arguments besides the names of functions
+static const char* const literal_words[] = {"NULL","TRUE","FALSE","NOT","AND","OR","IS",NULL};
+
+static int token_in(const char* token, int len, const char* const* words) {
+	for(; *words; words++)
+		if(token_is(token,len,*words))
+			return 1;
+	return 0;
+}
+
+// the index sqlite gives a parameter token of the statement, numbering anonymous ones after the highest so far
+static int param_index(sqlite3_stmt* stmt, const char* token, int len, int* max) {
+	int i;
+	if(len == 1)
+		i = *max+1;
+	else if(*token == '?')
+		i = atoi(token+1);
+	else {
+		char* name = sqlite3_mprintf("%.*s",len,token);
+		if(!name)
+			return -1;
+		i = sqlite3_bind_parameter_index(stmt,name);
+		sqlite3_free(name);
+	}
+	if(i > *max)
+		*max = i;
+	return i;
+}
+
+// the connected statement table a name refers to, resolving unqualified names as sqlite does as far as statement
+// tables go: temp first, then main, then whichever other database has one if only one does
+static struct statement_vtab* vtab_lookup(struct statement_vtab_context* context, sqlite3* db, const char* schema, int schema_len,
+	int schema_type, const char* name, int name_len, int name_type) {
+	struct statement_vtab* found = NULL;
+	int others = 0;
+	for(struct statement_vtab* other = context->vtabs; other; other = other->next) {
+		if(other->db != db || !token_names(name,name_len,name_type,other->name))
+			continue;
+		if(schema) {
+			if(token_names(schema,schema_len,schema_type,other->schema))
+				return other;
+		} else if(!sqlite3_stricmp(other->schema,"temp"))
+			return other;
+		else if(!sqlite3_stricmp(other->schema,"main"))
+			found = other;
+		else if(!others++ && !found)
+			found = other;
+	}
+	if(found && others > 1 && sqlite3_stricmp(found->schema,"main"))
+		return NULL;
+	return found;
+}
+
+// the statement of target as a subquery, with the arguments of its call put in place of its parameters, or NULL if the
+// call doesn't qualify. as the arguments are put wherever their parameter is used rather than bound once, they mustn't
+// refer to the outer query, and those calling functions or taking anonymous parameters only qualify if used once
+static char* inline_call(struct statement_vtab* target, const char* args, int* args_len, int* ret) {
+	struct inline_arg {
+		const char* p;
+		int len;
+		int once;
+	}* arg = sqlite3_malloc64(sizeof(*arg)*(target->num_inputs+1));
+	int* uses = sqlite3_malloc64(sizeof(*uses)*(target->num_inputs+1));
+	sqlite3_stmt* stmt = NULL;
+	char* sql = NULL;
+	int num_args = 0, depth = 0, ok = 1, len, type;
+	if(!arg || !uses) {
+		*ret = SQLITE_NOMEM;
+		goto done;
+	}
+	memset(uses,0,sizeof(*uses)*(target->num_inputs+1));
+	const char* p = args;
+	for(struct inline_arg* a = NULL; ok; p += len) {
+		p = sql_next(p,&len,&type);
+		if(type == TOKEN_END || (type == TOKEN_OTHER && (*p == ')' || *p == ',') && !depth)) {
+			ok = type != TOKEN_END && (a || (*p == ')' && !num_args));
+			if(*p == ')')
+				break;
+			a = NULL;
+			continue;
+		}
+		if(!a) {
+			if(num_args == target->num_inputs) {
+				ok = 0;
+				break;
+			}
+			a = &arg[num_args++];
+			a->p = p;
+			a->once = 0;
+		}
+		if(type == TOKEN_OTHER && *p == '(')
+			depth++;
+		else if(type == TOKEN_OTHER && *p == ')')
+			depth--;
+		else if(type == TOKEN_WORD) {
+			int n, t;
+			const char* next = sql_next(p+len,&n,&t);
+			if(t == TOKEN_OTHER && *next == '(')
+				a->once = 1;
+			else if(!token_in(p,len,literal_words))
+				ok = 0;
+		} else if(type == TOKEN_QUOTED)
+			ok = 0;
+		else if(type == TOKEN_PARAM && len == 1)
+			a->once = 1;
+		a->len = (int)(p+len-a->p);
+	}
+	*args_len = (int)(p+len-args);
+	if(!ok || (*ret = statement_acquire(target,0,&stmt)) != SQLITE_OK)
+		goto done;
+
+	int max = 0, i;
+	for(const char* q = target->sql; (len = sql_token(q,&type)), type != TOKEN_END; q += len)
+		if(type == TOKEN_PARAM) {
+			if((i = param_index(stmt,q,len,&max)) < 0) {
+				*ret = SQLITE_NOMEM;
+				goto done;
+			}
+			if(i <= target->num_inputs)
+				uses[i]++;
+		}
+	for(i = 0; i < num_args; i++)
+		if(arg[i].once && uses[i+1] > 1)
+			goto done;
+	sqlite3_str* out = sqlite3_str_new(NULL);
+	sqlite3_str_appendchar(out,1,'(');
+	max = 0;
+	for(const char* q = target->sql; (len = sql_token(q,&type)), type != TOKEN_END; q += len)
+		if(type == TOKEN_SPACE) // a comment would swallow whatever follows its line
+			sqlite3_str_appendchar(out,1,' ');
+		else if(type != TOKEN_PARAM)
+			sqlite3_str_append(out,q,len);
+		else if((i = param_index(stmt,q,len,&max)) > 0 && i <= num_args)
+			sqlite3_str_appendf(out,"(%.*s)",arg[i-1].len,arg[i-1].p);
+		else if(i < 0)
+			*ret = SQLITE_NOMEM;
+		else
+			sqlite3_str_appendall(out,"NULL");
+	sqlite3_str_appendchar(out,1,')');
+	if(*ret != SQLITE_OK || (*ret = sqlite3_str_errcode(out)) != SQLITE_OK)
+		sqlite3_free(sqlite3_str_finish(out));
+	else
+		sql = sqlite3_str_finish(out);
+
+done:
+	if(stmt)
+		statement_release(target,0,stmt);
+	sqlite3_free(arg);
+	sqlite3_free(uses);
+	// a target that fails to prepare is left for the statement to fail on
+	if(*ret != SQLITE_NOMEM)
+		*ret = SQLITE_OK;
+	return sql;
+}
+
+// sql with the calls to statement tables in its from clauses inlined, or NULL if there are none that qualify
+static char* inline_references(struct statement_vtab* vtab, const char* sql, int* ret) {
+	sqlite3_str* out = sqlite3_str_new(NULL);
+	const char* copied = sql; // up to where sql was appended to out
+	sqlite3_uint64 in_from = 0; // by depth of parentheses
+	int depth = 0, table_next = 0, distinct = 0, len, type;
+	for(const char* p = sql; *ret == SQLITE_OK; p += len) {
+		p = sql_next(p,&len,&type);
+		if(type == TOKEN_END)
+			break;
+		int table = table_next, after_distinct = distinct;
+		sqlite3_uint64 bit = depth < 64 ? (sqlite3_uint64)1 << depth : 0;
+		table_next = distinct = 0;
+		if(type == TOKEN_OTHER && *p == '(') {
+			if(++depth < 64)
+				in_from &= ~((sqlite3_uint64)1 << depth);
+		} else if(type == TOKEN_OTHER && *p == ')')
+			depth -= depth > 0;
+		else if(type == TOKEN_OTHER && *p == ',')
+			table_next = (in_from & bit) != 0;
+		else if(type == TOKEN_WORD && (token_is(p,len,"JOIN") || (token_is(p,len,"FROM") && !after_distinct))) {
+			in_from |= bit;
+			table_next = bit != 0;
+		} else if(type == TOKEN_WORD && token_in(p,len,from_end_words))
+			in_from &= ~bit;
+		else if(type == TOKEN_WORD && token_is(p,len,"DISTINCT"))
+			distinct = 1;
+		else if(table && (type == TOKEN_WORD || type == TOKEN_QUOTED)) {
+			// [schema.]name(arguments)
+			const char *schema = NULL, *name = p;
+			int schema_len = 0, schema_type = 0, name_len = len, name_type = type, n, t;
+			const char* next = sql_next(p+len,&n,&t);
+			if(t == TOKEN_OTHER && *next == '.') {
+				schema = name;
+				schema_len = name_len;
+				schema_type = name_type;
+				name = sql_next(next+1,&name_len,&name_type);
+				next = sql_next(name+name_len,&n,&t);
+				if(name_type != TOKEN_WORD && name_type != TOKEN_QUOTED)
+					continue;
+			}
+			struct statement_vtab* target;
+			if(t != TOKEN_OTHER || *next != '(' || !(target = vtab_lookup(vtab->context,vtab->db,schema,schema_len,schema_type,name,name_len,name_type))
+				|| target->bulk)
+				continue;
+			int args_len;
+			char* subquery = inline_call(target,next+1,&args_len,ret);
+			if(!subquery)
+				continue;
+			sqlite3_str_append(out,copied,(int)(p-copied));
+			sqlite3_str_appendall(out,subquery);
+			sqlite3_free(subquery);
+			copied = next+1+args_len;
+			// the table keeps its name unless the query gives it an alias
+			next = sql_next(copied,&n,&t);
+			if(!(t == TOKEN_QUOTED || (t == TOKEN_WORD && !token_in(next,n,join_words))))
+				sqlite3_str_appendf(out," AS \"%w\"",target->name);
+			p = copied;
+			len = 0;
+		}
+	}
+	if(copied != sql)
+		sqlite3_str_appendall(out,copied);
+	if(*ret == SQLITE_OK && (*ret = sqlite3_str_errcode(out)) == SQLITE_OK && copied != sql)
+		return sqlite3_str_finish(out);
+	sqlite3_free(sqlite3_str_finish(out));
+	return NULL;
+}
+
+// gives a table with the inline option the program of its statement with other statement tables inlined, as long as
+// each round of inlining prepares and declares the same table as the statement did
+static int inline_statement(struct statement_vtab* vtab, const char** sql, char** inlined) {
+	char* current = sqlite3_mprintf("%.*s",(int)vtab->sql_len,*sql);
+	char* declaration = NULL;
+	char* signature = NULL;
+	int ret = current ? SQLITE_OK : SQLITE_NOMEM;
+	*inlined = NULL;
+	for(int depth = 0; current && ret == SQLITE_OK; depth++) {
+		// which also connects the statement tables it refers to, so that they can be found in the context
+		sqlite3_stmt* stmt = NULL;
+		if((ret = sqlite3_prepare_v2(vtab->db,current,-1,&stmt,NULL)) == SQLITE_OK) {
+			char* d = build_create_statement(stmt,vtab->bulk);
+			char* s = statement_signature(stmt);
+			if(!d || !s)
+				ret = SQLITE_NOMEM;
+			else if(!depth) {
+				declaration = d;
+				signature = s;
+				d = s = NULL;
+			} else if(!strcmp(d,declaration) && !strcmp(s,signature)) {
+				sqlite3_free(*inlined);
+				*inlined = current;
+				current = NULL;
+			}
+			sqlite3_free(d);
+			sqlite3_free(s);
+		}
+		sqlite3_finalize(stmt);
+		if(ret == SQLITE_NOMEM)
+			break;
+		// a statement that doesn't prepare is left to fail as usual, and a round that doesn't hold up to what came before
+		ret = SQLITE_OK;
+		if(current && (depth || !declaration))
+			break;
+		char* next = ret == SQLITE_OK && depth < STATEMENT_VTAB_INLINE_DEPTH ? inline_references(vtab,*inlined ? *inlined : current,&ret) : NULL;
+		sqlite3_free(current);
+		current = next;
+	}
+	sqlite3_free(current);
+	sqlite3_free(declaration);
+	sqlite3_free(signature);
+	struct statement_program* program = NULL;
+	if(ret == SQLITE_OK && *inlined && !(program = program_acquire(vtab->context,*inlined,strlen(*inlined))))
+		ret = SQLITE_NOMEM;
+	if(ret != SQLITE_OK) {
+		sqlite3_free(*inlined);
+		*inlined = NULL;
+		return ret;
+	}
+	if(program) {
+		program_unref(vtab->context,vtab->program);
+		vtab->program = program;
+		vtab->sql_len = strlen(*inlined);
+		*sql = *inlined;
+	}
+	return SQLITE_OK;
+}
+
+#ifdef STATEMENT_VTAB_INCREMENTAL
+// records the rowids written to the tables of incrementally materialized statements, as the row before the change
+// for updates and deletes and the row after it for inserts and updates
+static void delta_preupdate(void* pCtx, sqlite3* db, int op, const char* zDb, const char* zName, sqlite3_int64 iKey1, sqlite3_int64 iKey2) {
+	struct statement_vtab_context* context = pCtx;
+	(void)db;
+	for(struct statement_vtab* vtab = context->vtabs; vtab; vtab = vtab->next) {
+		struct statement_delta* delta = vtab->delta;
+		if(!delta || delta->overflow || sqlite3_stricmp(zName,delta->table) || sqlite3_stricmp(zDb,delta->schema))
+			continue;
+		sqlite3_int64 keys[2];
+		int n = 0;
+		if(op != SQLITE_INSERT)
+			keys[n++] = iKey1;
+		if(op != SQLITE_DELETE && !(n && iKey2 == iKey1))
+			keys[n++] = iKey2;
+		if(delta->num_keys+n > delta->cap_keys) {
+			int cap = delta->cap_keys ? delta->cap_keys*2 : 16;
+			sqlite3_int64* grown = delta->num_keys+n <= STATEMENT_VTAB_INCREMENTAL_KEYS ? sqlite3_realloc64(delta->keys,sizeof(*grown)*cap) : NULL;
+			if(!grown) {
+				delta->overflow = 1;
+				continue;
+			}
+			delta->keys = grown;
+			delta->cap_keys = cap;
+		}
+		memcpy(delta->keys+delta->num_keys,keys,sizeof(*keys)*n);
+		delta->num_keys += n;
+	}
+}
+
+// the name an identifier token stands for, without its quotes
+static char* token_identifier(const char* token, int len, int type) {
+	if(type != TOKEN_QUOTED)
+		return sqlite3_mprintf("%.*s",len,token);
+	char close = *token == '[' ? ']' : *token;
+	char* name = sqlite3_malloc64(len);
+	if(!name)
+		return NULL;
+	int n = 0;
+	for(int i = 1; i < len-1; i++) {
+		name[n++] = token[i];
+		if(token[i] == close && close != ']')
+			i++; // doubled quote
+	}
+	name[n] = 0;
+	return name;
+}
+
+// the database an unqualified table name resolves to, temp coming first, as long as it's a plain table there
+static int delta_resolve(sqlite3* db, const char* schema, const char* table, char** found) {
+	*found = NULL;
+	int ret = SQLITE_OK, num_dbs = 0;
+	while(sqlite3_db_name(db,num_dbs))
+		num_dbs++;
+	for(int i = 0; ret == SQLITE_OK && i < num_dbs; i++) {
+		const char* name = sqlite3_db_name(db,i < 2 ? !i : i);
+		if(schema && sqlite3_stricmp(schema,name))
+			continue;
+		char* sql = sqlite3_mprintf("SELECT type = 'table' AND sql NOT LIKE 'CREATE VIRTUAL%%' FROM \"%w\".sqlite_master"
+			" WHERE type IN ('table','view') AND name = ?1 COLLATE NOCASE",name);
+		if(!sql)
+			return SQLITE_NOMEM;
+		sqlite3_stmt* stmt = NULL;
+		if((ret = sqlite3_prepare_v2(db,sql,-1,&stmt,NULL)) == SQLITE_OK && (ret = sqlite3_bind_text(stmt,1,table,-1,SQLITE_STATIC)) == SQLITE_OK
+			&& (ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+			if(sqlite3_column_int(stmt,0) && !(*found = sqlite3_mprintf("%s",name)))
+				ret = SQLITE_NOMEM;
+			sqlite3_finalize(stmt);
+			sqlite3_free(sql);
+			return ret == SQLITE_NOMEM ? ret : SQLITE_OK;
+		}
+		sqlite3_finalize(stmt);
+		sqlite3_free(sql);
+		if(ret == SQLITE_DONE)
+			ret = SQLITE_OK;
+	}
+	return ret == SQLITE_NOMEM ? ret : SQLITE_OK;
+}
+
+// whether the vm code of a statement aggregates its rows, which an aggregate function without a group by does too
+static int delta_aggregates(sqlite3* db, const char* sql, int* aggregates) {
+	*aggregates = 1;
+	char* explain = sqlite3_mprintf("EXPLAIN %s",sql);
+	if(!explain)
+		return SQLITE_NOMEM;
+	sqlite3_stmt* stmt = NULL;
+	int ret = sqlite3_prepare_v2(db,explain,-1,&stmt,NULL);
+	sqlite3_free(explain);
+	if(ret == SQLITE_OK) {
+		*aggregates = 0;
+		while(!*aggregates && sqlite3_step(stmt) == SQLITE_ROW) {
+			const char* opcode = (const char*)sqlite3_column_text(stmt,1);
+			*aggregates = opcode && !strncmp(opcode,"Agg",3);
+		}
+		ret = sqlite3_finalize(stmt);
+	}
+	return ret == SQLITE_NOMEM ? ret : SQLITE_OK;
+}
+#endif
+
+// sets up materialize=incremental for statements of the form SELECT ... FROM [schema.]table [alias] [WHERE ...] with no
+// subqueries or window functions, leaving the table materialized in full otherwise
+static int delta_setup(struct statement_vtab* vtab) {
+#ifdef STATEMENT_VTAB_INCREMENTAL
+	const char* sql = vtab->sql;
+	const char *from = NULL, *where = NULL, *name, *schema = NULL, *qualifier;
+	int len, type, name_len, name_type, schema_len = 0, schema_type = 0, qualifier_len, depth = 0, distinct = 0;
+	const char* p = sql_next(sql,&len,&type);
+	if(!token_is(p,len,"SELECT"))
+		return SQLITE_OK;
+	p = sql_next(p+len,&len,&type);
+	if(token_is(p,len,"DISTINCT"))
+		return SQLITE_OK;
+	for(; type != TOKEN_END && !from; p = sql_next(p+len,&len,&type)) {
+		int after_distinct = distinct;
+		distinct = 0;
+		if(type == TOKEN_OTHER && (*p == '(' || *p == ')'))
+			depth += *p == '(' ? 1 : -1;
+		else if(type == TOKEN_WORD && (token_is(p,len,"SELECT") || token_is(p,len,"OVER")))
+			return SQLITE_OK;
+		else if(type == TOKEN_WORD && token_is(p,len,"DISTINCT"))
+			distinct = 1;
+		else if(!depth && type == TOKEN_WORD && token_is(p,len,"FROM") && !after_distinct)
+			from = p;
+	}
+	if(!from || (type != TOKEN_WORD && type != TOKEN_QUOTED))
+		return SQLITE_OK;
+	name = p;
+	name_len = len;
+	name_type = type;
+	p = sql_next(p+len,&len,&type);
+	if(type == TOKEN_OTHER && *p == '.') {
+		schema = name;
+		schema_len = name_len;
+		schema_type = name_type;
+		name = sql_next(p+len,&name_len,&name_type);
+		if(name_type != TOKEN_WORD && name_type != TOKEN_QUOTED)
+			return SQLITE_OK;
+		p = sql_next(name+name_len,&len,&type);
+	}
+	qualifier = name;
+	qualifier_len = name_len;
+	if(token_is(p,len,"AS"))
+		p = sql_next(p+len,&len,&type);
+	if(type == TOKEN_QUOTED || (type == TOKEN_WORD && !token_in(p,len,join_words))) {
+		qualifier = p;
+		qualifier_len = len;
+		p = sql_next(p+len,&len,&type);
+	}
+	if(token_is(p,len,"WHERE")) {
+		where = p+len;
+		for(p = sql_next(where,&len,&type), depth = 0; type != TOKEN_END; p = sql_next(p+len,&len,&type))
+			if(type == TOKEN_OTHER && (*p == '(' || *p == ')'))
+				depth += *p == '(' ? 1 : -1;
+			else if(type == TOKEN_WORD && (token_is(p,len,"SELECT") || token_is(p,len,"OVER") || (!depth && token_in(p,len,from_end_words))))
+				return SQLITE_OK;
+	} else if(type != TOKEN_END)
+		return SQLITE_OK;
+
+	int ret = SQLITE_NOMEM, aggregates;
+	struct statement_delta* delta = sqlite3_malloc64(sizeof(*delta));
+	char *schema_name = NULL, *row_sql = NULL;
+	if(!delta)
+		return SQLITE_NOMEM;
+	memset(delta,0,sizeof(*delta));
+	if((schema && !(schema_name = token_identifier(schema,schema_len,schema_type))) || !(delta->table = token_identifier(name,name_len,name_type)))
+		goto done;
+	if((ret = delta_resolve(vtab->db,schema_name,delta->table,&delta->schema)) != SQLITE_OK || !delta->schema)
+		goto done;
+	ret = SQLITE_NOMEM;
+	sqlite3_str* keyed = sqlite3_str_new(NULL);
+	sqlite3_str_appendf(keyed,"%.*s, %.*s.rowid %s",(int)(from-sql),sql,qualifier_len,qualifier,from);
+	if(!(delta->keyed_sql = sqlite3_str_finish(keyed)))
+		goto done;
+	// a trailing comment of the where clause is kept to its own line
+	if(where)
+		row_sql = sqlite3_mprintf("%.*s, %.*s.rowid %.*s (\n%s\n) AND %.*s.rowid = ?1",(int)(from-sql),sql,qualifier_len,qualifier,
+			(int)(where-from),from,where,qualifier_len,qualifier);
+	else
+		row_sql = sqlite3_mprintf("%s\nWHERE %.*s.rowid = ?1",delta->keyed_sql,qualifier_len,qualifier);
+	if(!row_sql || (ret = delta_aggregates(vtab->db,delta->keyed_sql,&aggregates)) != SQLITE_OK || aggregates)
+		goto done;
+	if(sqlite3_prepare_v3(vtab->db,row_sql,-1,SQLITE_PREPARE_PERSISTENT,&delta->row_stmt,NULL) != SQLITE_OK
+		|| sqlite3_column_count(delta->row_stmt) != vtab->num_outputs+1 || sqlite3_bind_parameter_count(delta->row_stmt) != 1)
+		goto done;
+
+	// the hook is taken once for the connection, applying to its incrementally materialized tables from then on
+	if(!vtab->context->preupdate) {
+		sqlite3_preupdate_hook(vtab->db,delta_preupdate,vtab->context);
+		vtab->context->preupdate = 1;
+	}
+	vtab->delta = delta;
+	delta = NULL;
+done:
+	if(ret != SQLITE_NOMEM)
+		ret = SQLITE_OK;
+	delta_free(delta);
+	sqlite3_free(schema_name);
+	sqlite3_free(row_sql);
+	return ret;
+#else
+	(void)vtab;
+	return SQLITE_OK;
+#endif
+}
+
+static int function_register(struct statement_vtab* vtab, char** pzErr);
+
+// xCreate derives the schema of the vtab from the statement and keeps it in the shadow table, which xConnect then
+// declares the vtab from if it can. options are parsed either way as they are not kept
+static int statement_vtab_setup(sqlite3* db, void* pAux, int argc, const char* const* argv, sqlite3_vtab** ppVtab, char** pzErr, int create) {
+	size_t len;
+	if(argc < 4 || (len = strlen(argv[3])) < 3) {
+		if(!(*pzErr = sqlite3_mprintf("no statement provided")))
+			return SQLITE_NOMEM;
+		return SQLITE_MISUSE;
+	}
+	if(argv[3][0] != '(' || argv[3][len-1] != ')') {
+		if(!(*pzErr = sqlite3_mprintf("statement must be parenthesized")))
+			return SQLITE_NOMEM;
+		return SQLITE_MISUSE;
+	}
+
+	int ret;
+	sqlite3_mutex* mutex = sqlite3_db_mutex(db); // only needed to ensure correctness of sqlite3_errmsg
+	sqlite3_stmt* stmt = NULL;
+	char* declaration = NULL;
+
+	struct statement_vtab* vtab = sqlite3_malloc64(sizeof(*vtab));
+	if(!vtab)
+		return SQLITE_NOMEM;
+	memset(vtab,0,sizeof(*vtab));
+	*ppVtab = &vtab->base;
+
+	vtab->db = db;
+	vtab->context = pAux;
+	vtab->pool_max = STATEMENT_VTAB_POOL_SIZE;
+	vtab->cost = -1;
+	vtab->rows = -1;
+	vtab->slow_ns = -1;
+	vtab->sql_len = len-2;
+	const char* sql = argv[3]+1;
+	char* inlined = NULL;
+	if(!(vtab->program = program_acquire(vtab->context,sql,vtab->sql_len)) || !(vtab->schema = sqlite3_mprintf("%s",argv[1]))
+		|| !(vtab->name = sqlite3_mprintf("%s",argv[2]))) {
+		ret = SQLITE_NOMEM;
+		goto error;
+	}
+	if((ret = parse_options(vtab,argc,argv,pzErr)) != SQLITE_OK)
+		goto error;
+	// connections without the handler set through the extension can still connect and fail once the table is used
+	if(create && (vtab->budget_steps || vtab->budget_ns) && (ret = budget_usable(vtab,pzErr)) != SQLITE_OK)
+		goto error;
+	// done again when connecting, so that the table follows those it inlines as long as what it declares holds
+	if(vtab->inline_tables && (ret = inline_statement(vtab,&sql,&inlined)) != SQLITE_OK)
+		goto error;
+	struct statement_program* program = vtab->program;
+	int same_sql = program->variants[0].sql_len == (int)vtab->sql_len && !memcmp(program->variants[0].sql,sql,vtab->sql_len);
+	if(same_sql)
+		vtab->sql = program->variants[0].sql;
+	else
+		vtab->sql = sqlite3_mprintf("%.*s",vtab->sql_len,sql);
+	sqlite3_free(inlined);
+	if(!vtab->sql) {
+		ret = SQLITE_NOMEM;
+		goto error;
+	}
+
+	if(!create && vtab->registry) {
+		if((ret = registry_attach(vtab,&declaration)) != SQLITE_OK)
+			goto error;
+		if(declaration)
+			goto declare;
+	}
+	if(!create) {
+		// the options given when the table was created were applied to what was kept already, so they're put back
+		// should it not hold
+		double cost_option = vtab->cost;
+		sqlite3_int64 rows_option = vtab->rows;
+		int unique_option = vtab->unique, current;
+		sqlite3_mutex_enter(mutex);
+		if((ret = shadow_load(vtab,&declaration,&current)) != SQLITE_OK)
+			goto sqlite_error;
+		// what was kept only holds while the statement declares the same table, which changes along with the tables it
+		// reads. as long as the schema cookie is the same that's left to the first statement prepared, once the table is
+		// opened, which only tables in other databases could change. otherwise the statement is checked against it here,
+		// becoming the first pooled one, and the table derived anew if it doesn't match
+		if(declaration && !current && (ret = statement_acquire(vtab,0,&stmt)) == SQLITE_SCHEMA) {
+			sqlite3_free(vtab->base.zErrMsg);
+			vtab->base.zErrMsg = NULL;
+			sqlite3_free(declaration);
+			declaration = NULL;
+			sqlite3_free(vtab->signature);
+			vtab->signature = NULL;
+			sqlite3_free(vtab->order);
+			vtab->order = NULL;
+			vtab->order_len = 0;
+		} else if(ret != SQLITE_OK)
+			goto sqlite_error;
+		sqlite3_mutex_leave(mutex);
+		if(declaration)
+			goto declare;
+		vtab->cost = cost_option;
+		vtab->rows = rows_option;
+		vtab->unique = unique_option;
+	}
+
+	// the schema is derived from this statement so there's nothing to check it against
+	vtab->verified = 1;
+	sqlite3_mutex_enter(mutex);
+	if((ret = statement_acquire(vtab,0,&stmt)) != SQLITE_OK)
+		goto sqlite_error;
+	sqlite3_mutex_leave(mutex);
+	if(!sqlite3_stmt_readonly(stmt)) {
+		ret = SQLITE_ERROR;
+		if(!(*pzErr = sqlite3_mprintf("Statement must be read only.")))
+			ret = SQLITE_NOMEM;
+		goto error;
+	}
+
+	vtab->num_inputs = sqlite3_bind_parameter_count(stmt);
+	vtab->num_outputs = sqlite3_column_count(stmt);
+	// the cache of a table that isn't deterministic is only used as long as the databases are unchanged, as is a
+	// materialized result
+	if(vtab->materialize || (vtab->cache.max_bytes && !vtab->deterministic)) {
+		int too_old = 1;
+#ifdef STATEMENT_VTAB_MATERIALIZE
+		too_old = 0;
+#ifndef SQLITE_CORE
+		too_old = sqlite3_libversion_number() < 3039000;
+#endif
+#endif
+		if(too_old || (vtab->materialize && vtab->num_inputs)) {
+			ret = SQLITE_MISUSE;
+			if(!(*pzErr = !too_old ? sqlite3_mprintf("materialize requires a statement without parameters")
+				: sqlite3_mprintf("%s requires SQLite 3.39.0 or later",vtab->materialize ? "materialize" : "cache_bytes without deterministic")))
+				ret = SQLITE_NOMEM;
+			goto error;
+		}
+	}
+
+	// tables with the same sql analyse the statement only once between them
+	int unique_option = vtab->unique;
+	double cost = 1;
+	sqlite3_int64 rows = 1;
+	if(same_sql && program->derived) {
+		cost = program->cost;
+		rows = program->rows;
+		if(!vtab->unique && program->unique >= 0)
+			vtab->unique = program->unique;
+	}
+	sqlite3_mutex_enter(mutex);
+	if(!vtab->unique && !(same_sql && program->derived && program->unique >= 0) && (ret = at_most_one_row(db,vtab->sql,&vtab->unique)) != SQLITE_OK)
+		goto sqlite_error;
+	if(!(same_sql && program->derived) && (ret = estimate_plan(db,vtab->sql,&cost,&rows,&program->variants[0].sorted)) != SQLITE_OK)
+		goto sqlite_error;
+	sqlite3_mutex_leave(mutex);
+	if(same_sql && program->derived) {
+		if(program->order_len && !(vtab->order = sqlite3_malloc64(sizeof(*vtab->order)*program->order_len))) {
+			ret = SQLITE_NOMEM;
+			goto error;
+		}
+		if(program->order_len)
+			memcpy(vtab->order,program->order,sizeof(*vtab->order)*program->order_len);
+		vtab->order_len = program->order_len;
+	} else if((ret = find_order(vtab,stmt)) != SQLITE_OK)
+		goto error;
+	if(same_sql && !program->derived) {
+		program->cost = cost;
+		program->rows = rows;
+		program->unique = unique_option ? -1 : vtab->unique;
+		if(vtab->order_len && !(program->order = sqlite3_malloc64(sizeof(*program->order)*vtab->order_len))) {
+			ret = SQLITE_NOMEM;
+			goto error;
+		}
+		if(vtab->order_len)
+			memcpy(program->order,vtab->order,sizeof(*program->order)*vtab->order_len);
+		program->order_len = vtab->order_len;
+		program->derived = 1;
+	}
+	if(vtab->unique && rows > 1)
+		rows = 1;
+	if(vtab->rows < 0)
+		vtab->rows = rows;
+	if(vtab->cost < 0)
+		vtab->cost = cost;
+
+	if(!(declaration = build_create_statement(stmt,vtab->bulk)) || !(vtab->signature = statement_signature(stmt))) {
+		ret = SQLITE_NOMEM;
+		goto error;
+	}
+
+declare:
+	sqlite3_mutex_enter(mutex);
+	if((ret = sqlite3_declare_vtab(db,declaration)) != SQLITE_OK)
+		goto sqlite_error;
+	if(create && (ret = shadow_store(vtab,declaration)) != SQLITE_OK)
+		goto sqlite_error;
+	sqlite3_mutex_leave(mutex);
+	if(vtab->registry && !vtab->registered && (ret = registry_publish(vtab,declaration)) != SQLITE_OK)
+		goto error;
+	if(vtab->innocuous) {
+		ret = SQLITE_MISUSE;
+#ifdef STATEMENT_VTAB_INNOCUOUS
+#ifndef SQLITE_CORE
+		if(sqlite3_libversion_number() >= 3031000)
+#endif
+			ret = sqlite3_vtab_config(db,SQLITE_VTAB_INNOCUOUS);
+#endif
+		if(ret != SQLITE_OK) {
+			if(!(*pzErr = sqlite3_mprintf("innocuous requires SQLite 3.31.0 or later")))
+				ret = SQLITE_NOMEM;
+			goto error;
+		}
+	}
+	if(vtab->function && (ret = function_register(vtab,pzErr)) != SQLITE_OK)
+		goto error;
+	if(vtab->incremental && (ret = delta_setup(vtab)) != SQLITE_OK)
+		goto error;
+	if(vtab->cache_shared && (ret = shared_setup(vtab)) != SQLITE_OK)
+		goto error;
+
+	sqlite3_free(declaration);
+	// the statement used to derive the schema becomes the first pooled one
+	if(stmt)
+		statement_release(vtab,0,stmt);
+	if((vtab->next = vtab->context->vtabs))
+		vtab->next->prev = vtab;
+	vtab->context->vtabs = vtab;
+	return SQLITE_OK;
+
+sqlite_error:
+	if(!(*pzErr = sqlite3_mprintf("%s",sqlite3_errmsg(db))))
+		ret = SQLITE_NOMEM;
+	sqlite3_mutex_leave(mutex);
+error:
+	sqlite3_free(declaration);
+	sqlite3_finalize(stmt);
+	statement_vtab_destroy(*ppVtab);
+	*ppVtab = NULL;
+	return ret;
+}
+
+static int statement_vtab_create(sqlite3* db, void* pAux, int argc, const char* const* argv, sqlite3_vtab** ppVtab, char** pzErr) {
+	return statement_vtab_setup(db,pAux,argc,argv,ppVtab,pzErr,1);
+}
+
+// if these point to the literal same function sqlite makes statement_vtab eponymous, which we don't want
+static int statement_vtab_connect(sqlite3* db, void* pAux, int argc, const char* const* argv, sqlite3_vtab** ppVtab, char** pzErr) {
+	return statement_vtab_setup(db,pAux,argc,argv,ppVtab,pzErr,0);
+}
+
+static int statement_vtab_drop(sqlite3_vtab* pVTab) {
+	struct statement_vtab* vtab = (struct statement_vtab*)pVTab;
+	char* sql = sqlite3_mprintf("DROP TABLE IF EXISTS \"%w\".\"%w_schema\"",vtab->schema,vtab->name);
+	if(!sql)
+		return SQLITE_NOMEM;
+	int ret = sqlite3_exec(vtab->db,sql,NULL,NULL,NULL);
+	sqlite3_free(sql);
+	if(ret != SQLITE_OK)
+		return ret;
+	if(vtab->registry)
+		registry_remove(vtab);
+	return statement_vtab_destroy(pVTab);
+}
+
+static int statement_vtab_rename(sqlite3_vtab* pVTab, const char* zNew) {
+	struct statement_vtab* vtab = (struct statement_vtab*)pVTab;
+	char* name = sqlite3_mprintf("%s",zNew);
+	// tables created before the shadow table was introduced don't have one to rename
+	char* sql = sqlite3_mprintf("SELECT 1 FROM \"%w\".sqlite_master WHERE type = 'table' AND name = '%q_schema'",vtab->schema,vtab->name);
+	sqlite3_stmt* stmt = NULL;
+	int ret = name && sql ? sqlite3_prepare_v2(vtab->db,sql,-1,&stmt,NULL) : SQLITE_NOMEM;
+	int exists = ret == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW;
+	if(ret == SQLITE_OK)
+		ret = sqlite3_finalize(stmt);
+	sqlite3_free(sql);
+	if(ret == SQLITE_OK && exists) {
+		if(!(sql = sqlite3_mprintf("ALTER TABLE \"%w\".\"%w_schema\" RENAME TO \"%w_schema\"",vtab->schema,vtab->name,zNew)))
+			ret = SQLITE_NOMEM;
+		else
+			ret = sqlite3_exec(vtab->db,sql,NULL,NULL,NULL);
+		sqlite3_free(sql);
+	}
+	if(ret != SQLITE_OK) {
+		sqlite3_free(name);
+		return ret;
+	}
+	sqlite3_free(vtab->name);
+	vtab->name = name;
+	return SQLITE_OK;
+}
+
+static int statement_vtab_shadow_name(const char* suffix) {
+	return !sqlite3_stricmp(suffix,"schema");
+}
+
+static int statement_vtab_open(sqlite3_vtab* pVTab, sqlite3_vtab_cursor** ppCursor) {
+	struct statement_vtab* vtab = (struct statement_vtab*)pVTab;
+	// the values bound to parameters follow the cursor in the same allocation
+	struct statement_cursor* cur = sqlite3_malloc64(sizeof(*cur)+sizeof(*cur->param_argv)*vtab->num_inputs);
+	if(!cur)
+		return SQLITE_NOMEM;
+	memset(cur,0,sizeof(*cur));
+	cur->observed = -1;
+	if(vtab->num_inputs)
+		cur->param_argv = (sqlite3_value**)(cur+1);
+	vtab->stats.opens++;
+
+	int ret;
+	if((ret = statement_acquire(vtab,0,&cur->stmt)) == SQLITE_OK) {
+		*ppCursor = &cur->base;
+		return SQLITE_OK;
+	}
+	sqlite3_free(cur);
+	return ret;
+}
+
+static void in_clear(struct statement_cursor* cur) {
+	for(int i = 0; i < cur->in_len; i++) {
+		for(int j = 0; j < cur->in[i].num_values; j++)
+			sqlite3_value_free(cur->in[i].values[j]);
+		sqlite3_free(cur->in[i].values);
+	}
+	cur->in_len = 0;
+}
+
+#ifdef STATEMENT_VTAB_IN
+// copy the values on the right of an IN constraint, leaving out NULLs since those never compare equal
+static int in_load(struct statement_in* in, sqlite3_value* list) {
+	int cap = 0;
+	sqlite3_value* value;
+	int ret;
+	for(ret = sqlite3_vtab_in_first(list,&value); ret == SQLITE_OK && value; ret = sqlite3_vtab_in_next(list,&value)) {
+		if(sqlite3_value_type(value) == SQLITE_NULL)
+			continue;
+		if(in->num_values == cap) {
+			sqlite3_value** values = sqlite3_realloc64(in->values,sizeof(*values)*(cap = cap ? cap*2 : 16));
+			if(!values)
+				return SQLITE_NOMEM;
+			in->values = values;
+		}
+		if(!(in->values[in->num_values] = sqlite3_value_dup(value)))
+			return SQLITE_NOMEM;
+		in->num_values++;
+	}
+	return ret == SQLITE_DONE ? SQLITE_OK : ret;
+}
+#endif
+
+static int in_bind(struct statement_cursor* cur, int i) {
+	struct statement_in* in = &cur->in[i];
+	if(in->param <= ((struct statement_vtab*)cur->base.pVtab)->num_inputs)
+		cur->param_argv[in->param-1] = in->values[in->at];
+	return sqlite3_bind_value(cur->stmt,in->param,in->values[in->at]);
+}
+
+#ifdef STATEMENT_VTAB_PARALLEL
+int sqlite3_statementvtab_init(sqlite3* db, char** pzErrMsg, const sqlite3_api_routines* pApi);
+
+// one parameter set of a scan run by parallel workers, with the rows it produced
+struct statement_job {
+	sqlite3_value** values; // bound to each parameter, by parameter index
+	sqlite3_int64 ordinal;
+	struct statement_cache_entry* entry;
+	int ret;
+	char* err;
+	int done;
+};
+
+struct statement_batch {
+	struct statement_vtab* vtab;
+	sqlite3_snapshot* snapshot;
+	int num_params;
+	struct statement_job* jobs;
+	int num_jobs;
+	int cap_jobs;
+	sqlite3_value** base; // copies of the parameters shared by all jobs
+	int tuples; // whether the values of each job are copies of their own, made from bulk tuples
+	// taken under mutex: workers take jobs in order, running at most window jobs ahead of the cursor to bound what's buffered
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int next_job;
+	int consumed;
+	int window;
+	int running;
+	int cancel;
+	int ret; // failure of a worker outside of any job, which stops the others
+	char* err;
+	struct statement_thread {
+		struct statement_batch* batch;
+		sqlite3* db;
+		sqlite3_stmt* stmt;
+		pthread_t thread;
+	} threads[64];
+	int num_threads;
+};
+
+// whether the scan being filtered can be run on the reader connections of the table, opening them and preparing the
+// variant as needed. they read the snapshot of this connection's transaction, so anything they couldn't see the same way
+// leaves the scan to run serially: autocommit, changes of an open write transaction, in-memory or attached databases,
+// or a statement that doesn't prepare on them as it uses functions or modules only registered on this connection
+static int parallel_ready(struct statement_cursor* cur, sqlite3_snapshot** snapshot) {
+	struct statement_vtab* vtab = (struct statement_vtab*)cur->base.pVtab;
+	struct statement_variant* v = &vtab->program->variants[cur->variant];
+	const char* filename;
+	if(vtab->parallel < 2 || vtab->workers_busy || v->serial || !sqlite3_threadsafe() || sqlite3_get_autocommit(vtab->db)
+		|| sqlite3_txn_state(vtab->db,"main") == SQLITE_TXN_WRITE || sqlite3_db_name(vtab->db,2)
+		|| !(filename = sqlite3_db_filename(vtab->db,"main")) || !*filename)
+		return 0;
+	if(vtab->num_workers < vtab->parallel) {
+		struct statement_worker* workers = sqlite3_realloc64(vtab->workers,sizeof(*workers)*vtab->parallel);
+		if(!workers)
+			return 0;
+		vtab->workers = workers;
+		while(vtab->num_workers < vtab->parallel) {
+			struct statement_worker* worker = &workers[vtab->num_workers];
+			memset(worker,0,sizeof(*worker));
+			// statement tables within the statement are run by the workers as well
+			if(sqlite3_open_v2(filename,&worker->db,SQLITE_OPEN_READONLY|SQLITE_OPEN_NOMUTEX,NULL) != SQLITE_OK
+				|| sqlite3_statementvtab_init(worker->db,NULL,NULL) != SQLITE_OK) {
+				sqlite3_close(worker->db);
+				vtab->parallel = vtab->num_workers;
+				break;
+			}
+			vtab->num_workers++;
+		}
+		if(vtab->parallel < 2)
+			return 0;
+	}
+	for(int i = 0; i < vtab->parallel; i++) {
+		struct statement_worker* worker = &vtab->workers[i];
+		if(worker->num_stmts < vtab->program->num_variants) {
+			sqlite3_stmt** stmts = sqlite3_realloc64(worker->stmts,sizeof(*stmts)*vtab->program->num_variants);
+			if(!stmts)
+				return 0;
+			memset(stmts+worker->num_stmts,0,sizeof(*stmts)*(vtab->program->num_variants-worker->num_stmts));
+			worker->stmts = stmts;
+			worker->num_stmts = vtab->program->num_variants;
+		}
+		sqlite3_stmt** stmt = &worker->stmts[cur->variant];
+		if(!*stmt && (sqlite3_prepare_v3(worker->db,v->sql,v->sql_len,SQLITE_PREPARE_PERSISTENT,stmt,NULL) != SQLITE_OK
+			|| sqlite3_column_count(*stmt) != sqlite3_column_count(cur->stmt)
+			|| sqlite3_bind_parameter_count(*stmt) != sqlite3_bind_parameter_count(cur->stmt))) {
+			sqlite3_finalize(*stmt);
+			*stmt = NULL;
+			v->serial = 1;
+			return 0;
+		}
+	}
+	return sqlite3_snapshot_get(vtab->db,"main",snapshot) == SQLITE_OK;
+}
+
+static struct statement_batch* batch_new(struct statement_cursor* cur, sqlite3_snapshot* snapshot) {
+	struct statement_batch* batch = sqlite3_malloc64(sizeof(*batch));
+	if(!batch) {
+		sqlite3_snapshot_free(snapshot);
+		return NULL;
+	}
+	memset(batch,0,sizeof(*batch));
+	batch->vtab = (struct statement_vtab*)cur->base.pVtab;
+	batch->snapshot = snapshot;
+	batch->num_params = sqlite3_bind_parameter_count(cur->stmt);
+	return batch;
+}
+
+static struct statement_job* batch_job(struct statement_batch* batch) {
+	if(batch->num_jobs == batch->cap_jobs) {
+		int cap = batch->cap_jobs ? batch->cap_jobs*2 : 16;
+		struct statement_job* jobs = sqlite3_realloc64(batch->jobs,sizeof(*jobs)*cap);
+		if(!jobs)
+			return NULL;
+		batch->jobs = jobs;
+		batch->cap_jobs = cap;
+	}
+	struct statement_job* job = &batch->jobs[batch->num_jobs];
+	memset(job,0,sizeof(*job));
+	if(batch->num_params && !(job->values = sqlite3_malloc64(sizeof(*job->values)*batch->num_params)))
+		return NULL;
+	if(batch->num_params)
+		memset(job->values,0,sizeof(*job->values)*batch->num_params);
+	batch->num_jobs++;
+	return job;
+}
+
+// threads have to be joined before this
+static void batch_free(struct statement_batch* batch) {
+	for(int i = 0; i < batch->num_jobs; i++) {
+		struct statement_job* job = &batch->jobs[i];
+		for(int j = 0; batch->tuples && j < batch->num_params; j++)
+			sqlite3_value_free(job->values[j]);
+		sqlite3_free(job->values);
+		cache_entry_unref(job->entry);
+		sqlite3_free(job->err);
+	}
+	sqlite3_free(batch->jobs);
+	for(int i = 0; batch->base && i < batch->num_params; i++)
+		sqlite3_value_free(batch->base[i]);
+	sqlite3_free(batch->base);
+	sqlite3_free(batch->err);
+	sqlite3_snapshot_free(batch->snapshot);
+	sqlite3_free(batch);
+}
+
+static int job_run(struct statement_batch* batch, sqlite3_stmt* stmt, struct statement_job* job) {
+	int ret = SQLITE_OK;
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+	for(int i = 0; i < batch->num_params && ret == SQLITE_OK; i++)
+		if(job->values[i])
+			ret = sqlite3_bind_value(stmt,i+1,job->values[i]);
+	if(ret == SQLITE_OK && !(job->entry = sqlite3_malloc64(sizeof(*job->entry))))
+		ret = SQLITE_NOMEM;
+	if(ret != SQLITE_OK)
+		return ret;
+	memset(job->entry,0,sizeof(*job->entry));
+	job->entry->refs = 1;
+	job->entry->rows.num_cols = batch->vtab->num_outputs;
+	while((ret = sqlite3_step(stmt)) == SQLITE_ROW && (ret = rows_append(&job->entry->rows,stmt)) == SQLITE_OK)
+		;
+	if(ret == SQLITE_DONE)
+		return SQLITE_OK;
+	job->err = sqlite3_mprintf("%s",sqlite3_errmsg(sqlite3_db_handle(stmt)));
+	return ret;
+}
+
+static void* batch_worker(void* arg) {
+	struct statement_thread* thread = arg;
+	struct statement_batch* batch = thread->batch;
+	int ret;
+	if(!sqlite3_get_autocommit(thread->db))
+		sqlite3_exec(thread->db,"ROLLBACK",NULL,NULL,NULL);
+	if((ret = sqlite3_exec(thread->db,"BEGIN",NULL,NULL,NULL)) != SQLITE_OK
+		|| (ret = sqlite3_snapshot_open(thread->db,"main",batch->snapshot)) != SQLITE_OK) {
+		pthread_mutex_lock(&batch->mutex);
+		if(!batch->ret) {
+			batch->ret = ret;
+			batch->err = sqlite3_mprintf("%s",sqlite3_errmsg(thread->db));
+		}
+		batch->cancel = 1;
+	} else {
+		pthread_mutex_lock(&batch->mutex);
+		for(;;) {
+			while(!batch->cancel && batch->next_job < batch->num_jobs && batch->next_job >= batch->consumed+batch->window)
+				pthread_cond_wait(&batch->cond,&batch->mutex);
+			if(batch->cancel || batch->next_job >= batch->num_jobs)
+				break;
+			struct statement_job* job = &batch->jobs[batch->next_job++];
+			pthread_mutex_unlock(&batch->mutex);
+			ret = job_run(batch,thread->stmt,job);
+			pthread_mutex_lock(&batch->mutex);
+			job->ret = ret;
+			job->done = 1;
+			pthread_cond_broadcast(&batch->cond);
+		}
+	}
+	batch->running--;
+	pthread_cond_broadcast(&batch->cond);
+	pthread_mutex_unlock(&batch->mutex);
+	sqlite3_reset(thread->stmt);
+	sqlite3_clear_bindings(thread->stmt);
+	sqlite3_exec(thread->db,"COMMIT",NULL,NULL,NULL);
+	return NULL;
+}
+
+// hand the rows of the next job that has any over to the cursor as its entry, waiting for the workers as needed
+static int batch_next(struct statement_cursor* cur) {
+	struct statement_batch* batch = cur->batch;
+	struct statement_vtab* vtab = batch->vtab;
+	while(batch->consumed < batch->num_jobs) {
+		struct statement_job* job = &batch->jobs[batch->consumed];
+		pthread_mutex_lock(&batch->mutex);
+		while(!job->done && batch->running)
+			pthread_cond_wait(&batch->cond,&batch->mutex);
+		batch->consumed++;
+		pthread_cond_broadcast(&batch->cond);
+		pthread_mutex_unlock(&batch->mutex);
+		if(!job->done || job->ret != SQLITE_OK) {
+			int ret = job->done ? job->ret : batch->ret ? batch->ret : SQLITE_INTERRUPT;
+			const char* err = job->done ? job->err : batch->err;
+			sqlite3_free(vtab->base.zErrMsg);
+			vtab->base.zErrMsg = sqlite3_mprintf("%s",err ? err : sqlite3_errstr(ret));
+			return ret;
+		}
+		cache_entry_unref(cur->entry);
+		cur->entry = job->entry;
+		cur->entry_row = 0;
+		job->entry = NULL;
+		cur->ordinal = job->ordinal;
+		for(int i = 0; i < vtab->num_inputs; i++)
+			cur->param_argv[i] = job->values[i];
+		if(cur->entry->rows.num_rows) {
+			vtab->stats.rows++;
+			break;
+		}
+	}
+	return SQLITE_OK;
+}
+
+// start a thread per worker connection on the jobs of a batch, running them in this one if none can be started
+static int batch_run(struct statement_cursor* cur, struct statement_batch* batch) {
+	struct statement_vtab* vtab = batch->vtab;
+	pthread_mutex_init(&batch->mutex,NULL);
+	pthread_cond_init(&batch->cond,NULL);
+	cur->batch = batch;
+	vtab->workers_busy = 1;
+	int num_threads = batch->num_jobs < vtab->parallel ? batch->num_jobs : vtab->parallel;
+	batch->window = num_threads*2;
+	for(int i = 0; i < num_threads; i++) {
+		struct statement_thread* thread = &batch->threads[batch->num_threads];
+		thread->batch = batch;
+		thread->db = vtab->workers[i].db;
+		thread->stmt = vtab->workers[i].stmts[cur->variant];
+		batch->running++;
+		if(pthread_create(&thread->thread,NULL,batch_worker,thread)) {
+			batch->running--;
+			break;
+		}
+		batch->num_threads++;
+	}
+	if(!batch->num_threads) {
+		batch->window = batch->num_jobs;
+		batch->running = 1;
+		batch->threads[0].batch = batch;
+		batch->threads[0].db = vtab->workers[0].db;
+		batch->threads[0].stmt = vtab->workers[0].stmts[cur->variant];
+		batch_worker(&batch->threads[0]);
+	}
+	return batch_next(cur);
+}
+
+// stop the workers of the batch of the cursor, if any, dropping what they produced and haven't been served yet
+static void batch_finish(struct statement_cursor* cur) {
+	struct statement_batch* batch = cur->batch;
+	if(!batch)
+		return;
+	pthread_mutex_lock(&batch->mutex);
+	batch->cancel = 1;
+	pthread_cond_broadcast(&batch->cond);
+	pthread_mutex_unlock(&batch->mutex);
+	for(int i = 0; i < batch->num_threads; i++) {
+		sqlite3_interrupt(batch->threads[i].db);
+		pthread_join(batch->threads[i].thread,NULL);
+	}
+	pthread_cond_destroy(&batch->cond);
+	pthread_mutex_destroy(&batch->mutex);
+	batch->vtab->workers_busy = 0;
+	batch_free(batch);
+	cur->batch = NULL;
+}
+
+// run each combination of the IN values of the cursor as a job, in the order the cursor would step through them itself
+static int batch_in(struct statement_cursor* cur, const char* idxStr, int argc, sqlite3_value** argv) {
+	sqlite3_int64 num_jobs = 1;
+	for(int i = 0; i < cur->in_len && num_jobs <= STATEMENT_VTAB_PARALLEL_MAX_JOBS; i++)
+		num_jobs *= cur->in[i].num_values;
+	sqlite3_snapshot* snapshot;
+	if(num_jobs < 2 || num_jobs > STATEMENT_VTAB_PARALLEL_MAX_JOBS || !parallel_ready(cur,&snapshot))
+		return SQLITE_OK;
+	struct statement_batch* batch = batch_new(cur,snapshot);
+	if(!batch || (batch->num_params && !(batch->base = sqlite3_malloc64(sizeof(*batch->base)*batch->num_params))))
+		goto nomem;
+	if(batch->num_params)
+		memset(batch->base,0,sizeof(*batch->base)*batch->num_params);
+	for(int i = 0; i < argc; i++) {
+		int param = idxStr?((int*)idxStr)[i]:i+1;
+		if(param > 0 && !(batch->base[param-1] = sqlite3_value_dup(argv[i])))
+			goto nomem;
+	}
+	for(sqlite3_int64 i = 0; i < num_jobs; i++) {
+		struct statement_job* job = batch_job(batch);
+		if(!job)
+			goto nomem;
+		memcpy(job->values,batch->base,sizeof(*job->values)*batch->num_params);
+		sqlite3_int64 at = i;
+		for(int j = cur->in_len-1; j >= 0; j--) {
+			job->values[cur->in[j].param-1] = cur->in[j].values[at % cur->in[j].num_values];
+			at /= cur->in[j].num_values;
+		}
+	}
+	return batch_run(cur,batch);
+
+nomem:
+	if(batch)
+		batch_free(batch);
+	return SQLITE_NOMEM;
+}
+#endif
+
+// logs the run of the statement that has finished, or is being abandoned, if it took as long as the slow_ms option
+// allows, along with the parameters it was bound to and the plan of its statement. through sqlite3_log, so it's up to
+// the application to have set up SQLITE_CONFIG_LOG
+static void slow_check(struct statement_cursor* cur) {
+	struct statement_vtab* vtab = (struct statement_vtab*)cur->base.pVtab;
+	sqlite3_int64 elapsed = cur->run_ns, rows = cur->run_rows;
+	if(vtab->slow_ns < 0 || !elapsed || elapsed < vtab->slow_ns || !cur->stmt)
+		return;
+	char* sql = sqlite3_expanded_sql(cur->stmt); // NULL if built without it, leaving the parameters out
+	sqlite3_str* plan = sqlite3_str_new(NULL);
+	int ret = plan_describe(vtab->db,vtab->program->variants[cur->variant].sql,plan,0);
+	char* plan_text = sqlite3_str_finish(plan);
+	sqlite3_log(SQLITE_WARNING,"slow statement table %s.%s: %.3f ms for %lld rows of %s; plan: %s",vtab->schema,vtab->name,elapsed/1e6,
+		rows,sql ? sql : sqlite3_sql(cur->stmt),ret == SQLITE_OK && plan_text ? plan_text : sqlite3_errstr(ret));
+	sqlite3_free(sql);
+	sqlite3_free(plan_text);
+}
+
+// the parameters bound by a scan, as kept by struct statement_observed
+static sqlite3_uint64 param_bit(int param) {
+	return (sqlite3_uint64)1 << (param <= 64 ? param-1 : 63);
+}
+
+// where runs of the statement with this variant and parameters are recorded, adding it if there's room
+static int observed_find(struct statement_vtab* vtab, int variant, sqlite3_uint64 params, int add) {
+	for(int i = 0; i < vtab->num_observed; i++)
+		if(vtab->observed[i].variant == variant && vtab->observed[i].params == params)
+			return i;
+	if(!add || vtab->num_observed == STATEMENT_VTAB_MAX_OBSERVED)
+		return -1;
+	if(!(vtab->num_observed & (vtab->num_observed-1))) {
+		struct statement_observed* observed = sqlite3_realloc64(vtab->observed,sizeof(*observed)*(vtab->num_observed ? 2*vtab->num_observed : 1));
+		if(!observed)
+			return -1;
+		vtab->observed = observed;
+	}
+	struct statement_observed* o = &vtab->observed[vtab->num_observed];
+	memset(o,0,sizeof(*o));
+	o->variant = variant;
+	o->params = params;
+	return vtab->num_observed++;
+}
+
+// ends the current run of the statement, recording it with the feedback option if it ran to completion rather
+// than being abandoned, as runs cut short by the outer query say little about what the statement yields
+static void run_end(struct statement_cursor* cur, int completed) {
+	struct statement_vtab* vtab = (struct statement_vtab*)cur->base.pVtab;
+	if(completed && cur->run_started && cur->observed >= 0) {
+		struct statement_observed* o = &vtab->observed[cur->observed];
+		double weight = 1.0/(o->runs < vtab->feedback ? o->runs+1 : vtab->feedback);
+		o->runs++;
+		o->rows += (cur->run_rows-o->rows)*weight;
+		o->vm_steps += (sqlite3_stmt_status(cur->stmt,SQLITE_STMTSTATUS_VM_STEP,0)-cur->run_vm_steps-o->vm_steps)*weight;
+	}
+	slow_check(cur);
+	cur->run_started = 0;
+	cur->run_ns = cur->run_rows = 0;
+}
+
+static int statement_vtab_close(sqlite3_vtab_cursor* cur){
+	struct statement_cursor* stmtcur = (struct statement_cursor*)cur;
+#ifdef STATEMENT_VTAB_PARALLEL
+	batch_finish(stmtcur);
+#endif
+	run_end(stmtcur,0);
+	if(stmtcur->stmt)
+		statement_release((struct statement_vtab*)cur->pVtab,stmtcur->variant,stmtcur->stmt);
+	cache_entry_unref(stmtcur->entry);
+	cache_entry_unref(stmtcur->fill);
+	cache_entry_unref(stmtcur->prefetch);
+	in_clear(stmtcur);
+	sqlite3_free(stmtcur->in);
+	sqlite3_finalize(stmtcur->tuples_stmt);
+	sqlite3_free(cur);
+	return SQLITE_OK;
+}
+
+// record the rows of a cache miss as they are stepped, and hand them over to the cache once the statement completes
+static int statement_cursor_stepped(struct statement_cursor* cur, int ret) {
+	struct statement_vtab* vtab = (struct statement_vtab*)cur->base.pVtab;
+	if(!cur->fill)
+		return ret;
+	struct statement_shard* shard = vtab->shared_file ? shared_shard(cur->fill->hash) : NULL;
+	struct statement_cache* cache = shard ? &shard->cache : &vtab->cache;
+	if(ret == SQLITE_ROW) {
+		if(rows_append(&cur->fill->rows,cur->stmt) == SQLITE_OK && cache_entry_bytes(cur->fill) <= cache->max_bytes)
+			return ret;
+	} else if(ret == SQLITE_DONE) {
+		if(shard) {
+			sqlite3_mutex_enter(shard->mutex);
+			cur->fill->mutex = shard->mutex;
+			cache_insert(cache,cur->fill);
+			sqlite3_mutex_leave(shard->mutex);
+		} else
+			cache_insert(cache,cur->fill);
+		cur->fill = NULL;
+		return ret;
+	}
+	cache_entry_unref(cur->fill);
+	cur->fill = NULL;
+	return ret;
+}
+
+// steps the statement as such, keeping count of rows and time spent for the stats table and the slow_ms option
+static int statement_step(struct statement_cursor* cur) {
+	struct statement_vtab* vtab = (struct statement_vtab*)cur->base.pVtab;
+	int ret;
+	if(!cur->run_started) {
+		cur->run_started = 1;
+		if(cur->observed >= 0)
+			cur->run_vm_steps = sqlite3_stmt_status(cur->stmt,SQLITE_STMTSTATUS_VM_STEP,0);
+	}
+	if(vtab->context->timing || vtab->slow_ns >= 0) {
+		sqlite3_int64 start = clock_ns();
+		ret = sqlite3_step(cur->stmt);
+		sqlite3_int64 elapsed = clock_ns()-start;
+		vtab->stats.step_ns += elapsed;
+		if(elapsed > vtab->stats.max_step_ns)
+			vtab->stats.max_step_ns = elapsed;
+		// at least a nanosecond, so that slow_ms=0 logs every run
+		cur->run_ns += elapsed > 0 ? elapsed : 1;
+	} else
+		ret = sqlite3_step(cur->stmt);
+	if(ret == SQLITE_ROW) {
+		vtab->stats.rows++;
+		cur->run_rows++;
+	} else
+		run_end(cur,ret == SQLITE_DONE);
+	return ret;
+}
+
+// the parameter of the statement a key of a bulk tuple stands for, matching names without their prefix
+static int tuple_param(sqlite3_stmt* stmt, int num_inputs, sqlite3_value* key) {
+	if(sqlite3_value_type(key) == SQLITE_INTEGER) {
+		sqlite3_int64 index = sqlite3_value_int64(key);
+		return index >= 0 && index < num_inputs ? (int)index+1 : 0;
+	}
+	const char* name = (const char*)sqlite3_value_text(key);
+	int len = sqlite3_value_bytes(key);
+	for(int i = 1; name && i <= num_inputs; i++) {
+		const char* param = sqlite3_bind_parameter_name(stmt,i);
+		if(param && (int)strlen(param+1) == len && !memcmp(param+1,name,len))
+			return i;
+	}
+	return 0;
+}
+
+// binds a value of a tuple, or keeps a copy of it in values for a parallel worker to bind
+static int tuple_value(sqlite3_stmt* stmt, sqlite3_value** values, int param, sqlite3_value* value) {
+	if(!values)
+		return sqlite3_bind_value(stmt,param,value);
+	sqlite3_value_free(values[param-1]);
+	return (values[param-1] = sqlite3_value_dup(value)) ? SQLITE_OK : SQLITE_NOMEM;
+}
+
+// bind the next tuple of a bulk table, leaving tuples_stmt on the row of the one after it.
+// keys that match no parameter are left out, as are the parameters a tuple doesn't mention which stay NULL
+static int tuple_bind(struct statement_cursor* cur, sqlite3_value** values) {
+	struct statement_vtab* vtab = (struct statement_vtab*)cur->base.pVtab;
+	sqlite3_stmt* tuples = cur->tuples_stmt;
+	if(cur->tuples_done)
+		return SQLITE_DONE;
+	if(!values) {
+		sqlite3_reset(cur->stmt);
+		sqlite3_clear_bindings(cur->stmt);
+	}
+	cur->ordinal = sqlite3_column_int64(tuples,0);
+	sqlite3_int64 tuple = sqlite3_column_int64(tuples,3);
+	const char* type = (const char*)sqlite3_column_text(tuples,2);
+	int ret = SQLITE_OK;
+	if(type && strcmp(type,"array") && strcmp(type,"object") && vtab->num_inputs)
+		ret = tuple_value(cur->stmt,values,1,sqlite3_column_value(tuples,1));
+	while(ret == SQLITE_OK && (ret = sqlite3_step(tuples)) == SQLITE_ROW && sqlite3_column_int64(tuples,4) != cur->tuples_root) {
+		// anything nested deeper within a parameter's value comes with it already
+		int param = sqlite3_column_int64(tuples,4) == tuple ? tuple_param(cur->stmt,vtab->num_inputs,sqlite3_column_value(tuples,0)) : 0;
+		ret = param ? tuple_value(cur->stmt,values,param,sqlite3_column_value(tuples,1)) : SQLITE_OK;
+	}
+	if(ret == SQLITE_DONE)
+		cur->tuples_done = 1;
+	else if(ret != SQLITE_ROW) {
+		sqlite3_free(vtab->base.zErrMsg);
+		vtab->base.zErrMsg = sqlite3_mprintf("%s",sqlite3_errmsg(vtab->db));
+		return ret;
+	}
+	return SQLITE_ROW;
+}
+
+// bind the next combination of IN values, changing the last one first, or the next bulk tuple.
+// returns SQLITE_ROW when the statement is ready to run again and SQLITE_DONE once there are none left
+static int statement_cursor_rerun(struct statement_cursor* cur) {
+	if(cur->tuples_stmt)
+		return tuple_bind(cur,NULL);
+	int i = cur->in_len;
+	while(i > 0 && cur->in[i-1].at+1 >= cur->in[i-1].num_values)
+		i--;
+	if(!i)
+		return SQLITE_DONE;
+	cur->in[i-1].at++;
+	sqlite3_reset(cur->stmt);
+	for(int j = i-1; j < cur->in_len; j++) {
+		int ret;
+		if(j >= i)
+			cur->in[j].at = 0;
+		if((ret = in_bind(cur,j)) != SQLITE_OK)
+			return ret;
+	}
+	return SQLITE_ROW;
+}
+
+// step the statement, running it again each time it completes for as long as there are parameters left to run it with
+static int statement_cursor_step(struct statement_cursor* cur) {
+	int ret;
+	while((ret = statement_cursor_stepped(cur,statement_step(cur))) == SQLITE_DONE && (ret = statement_cursor_rerun(cur)) == SQLITE_ROW)
+		;
+	return ret;
+}
+
+// refill the buffer of the cursor with up to prefetch rows of the current run of the statement, going on to the next run
+// once it has none left. runs are reset as soon as they complete, ending their read of the database before their rows are served.
+// a buffer only ever holds rows of one run, so that the parameter columns of the cursor still apply to all of them
+static int prefetch_fill(struct statement_cursor* cur) {
+	struct statement_vtab* vtab = (struct statement_vtab*)cur->base.pVtab;
+	struct statement_rows* rows = &cur->prefetch->rows;
+	int ret = SQLITE_OK;
+	rows->num_rows = 0;
+	rows->arena_len = 0;
+	cur->entry_row = 0;
+	while(!rows->num_rows) {
+		if(cur->run_done && (ret = statement_cursor_rerun(cur)) != SQLITE_ROW)
+			return ret == SQLITE_DONE ? SQLITE_OK : ret;
+		cur->run_done = 0;
+		while(rows->num_rows < vtab->prefetch && (ret = statement_cursor_stepped(cur,statement_step(cur))) == SQLITE_ROW)
+			if((ret = rows_append(rows,cur->stmt)) != SQLITE_OK)
+				return ret;
+		if(ret == SQLITE_DONE) {
+			sqlite3_reset(cur->stmt);
+			cur->run_done = 1;
+		} else if(ret != SQLITE_OK && ret != SQLITE_ROW)
+			return ret;
+	}
+	return SQLITE_OK;
+}
+
+// start stepping the statement as bound by xFilter, through the buffer of the cursor with the prefetch option
+static int statement_cursor_start(struct statement_cursor* cur) {
+	struct statement_vtab* vtab = (struct statement_vtab*)cur->base.pVtab;
+	int ret;
+	if(!vtab->prefetch) {
+		ret = statement_cursor_step(cur);
+		return ret == SQLITE_ROW || ret == SQLITE_DONE ? SQLITE_OK : ret;
+	}
+	// the buffer is kept for the lifetime of the cursor, and served like a cache entry with a reference for each role
+	if(!cur->prefetch) {
+		if(!(cur->prefetch = sqlite3_malloc64(sizeof(*cur->prefetch))))
+			return SQLITE_NOMEM;
+		memset(cur->prefetch,0,sizeof(*cur->prefetch));
+		cur->prefetch->refs = 1;
+		cur->prefetch->rows.num_cols = vtab->num_outputs;
+	}
+	cur->prefetch->refs++;
+	cur->entry = cur->prefetch;
+	cur->run_done = 0;
+	return prefetch_fill(cur);
+}
+
+static int statement_cursor_next(sqlite3_vtab_cursor* cur){
+	struct statement_cursor* stmtcur = (struct statement_cursor*)cur;
+	if(stmtcur->entry) {
+		int ret;
+		// rows of the buffer were counted as they were stepped into it
+		if(++stmtcur->entry_row < stmtcur->entry->rows.num_rows) {
+			if(stmtcur->entry != stmtcur->prefetch)
+				((struct statement_vtab*)cur->pVtab)->stats.rows++;
+		} else if(stmtcur->entry == stmtcur->prefetch && (ret = prefetch_fill(stmtcur)) != SQLITE_OK)
+			return ret;
+#ifdef STATEMENT_VTAB_PARALLEL
+		else if(stmtcur->batch && (ret = batch_next(stmtcur)) != SQLITE_OK)
+			return ret;
+#endif
+		stmtcur->rowid++;
+		return SQLITE_OK;
+	}
+	int ret = statement_cursor_step(stmtcur);
+	if(ret == SQLITE_ROW) {
+		stmtcur->rowid++;
+		return SQLITE_OK;
+	}
+	return ret == SQLITE_DONE ? SQLITE_OK : ret;
+}
+
+static int statement_vtab_rowid(sqlite3_vtab_cursor* cur, sqlite_int64* pRowid) {
+	*pRowid = ((struct statement_cursor*)cur)->rowid;
+	return SQLITE_OK;
+}
+
+static int statement_vtab_eof(sqlite3_vtab_cursor* cur) {
+	struct statement_cursor* stmtcur = (struct statement_cursor*)cur;
+	if(stmtcur->entry)
+		return stmtcur->entry_row >= stmtcur->entry->rows.num_rows;
+	return !sqlite3_stmt_busy(stmtcur->stmt);
+}
+
+// numbers are passed on directly and NULL needs nothing at all since that's what xColumn starts out with;
+// text and blobs still take one copy as the result can outlive the current row of the statement it came from,
+// but sqlite3_result_value also carries over subtypes such as those of JSON values
+static void result_value(sqlite3_context* ctx, sqlite3_value* value) {
+	switch(sqlite3_value_type(value)) {
+	case SQLITE_INTEGER:
+		sqlite3_result_int64(ctx,sqlite3_value_int64(value));
+		break;
+	case SQLITE_FLOAT:
+		sqlite3_result_double(ctx,sqlite3_value_double(value));
+		break;
+	case SQLITE_NULL:
+		break;
+	default:
+		sqlite3_result_value(ctx,value);
+	}
+}
+
+static int statement_vtab_column(sqlite3_vtab_cursor* cur, sqlite3_context* ctx, int i) {
+	struct statement_cursor* stmtcur = (struct statement_cursor*)cur;
+	int num_outputs = ((struct statement_vtab*)cur->pVtab)->num_outputs;
+	if(i < num_outputs) {
+		if(stmtcur->entry)
+			rows_result(&stmtcur->entry->rows,stmtcur->entry_row,i,ctx);
+		else
+			result_value(ctx,sqlite3_column_value(stmtcur->stmt,i));
+	} else if(((struct statement_vtab*)cur->pVtab)->bulk) {
+		if(i == num_outputs)
+			sqlite3_result_int64(ctx,stmtcur->ordinal);
+		else if(stmtcur->tuples)
+			result_value(ctx,stmtcur->tuples);
+	} else if(stmtcur->param_argv[i-num_outputs])
+		result_value(ctx,stmtcur->param_argv[i-num_outputs]);
+	return SQLITE_OK;
+}
+
+// the cache key is the plan along with each bound parameter index, type and value
+static char* cache_key(int idxNum, const char* idxStr, int argc, sqlite3_value** argv, int* key_len) {
+	sqlite3_str* key = sqlite3_str_new(NULL);
+	sqlite3_str_append(key,(const char*)&idxNum,sizeof(idxNum));
+	for(int i = 0; i < argc; i++) {
+		int param = idxStr ? ((int*)idxStr)[i] : i+1;
+		char type = sqlite3_value_type(argv[i]);
+		sqlite3_str_append(key,(const char*)&param,sizeof(param));
+		sqlite3_str_append(key,&type,1);
+		if(type == SQLITE_INTEGER) {
+			sqlite3_int64 v = sqlite3_value_int64(argv[i]);
+			sqlite3_str_append(key,(const char*)&v,sizeof(v));
+		} else if(type == SQLITE_FLOAT) {
+			double v = sqlite3_value_double(argv[i]);
+			sqlite3_str_append(key,(const char*)&v,sizeof(v));
+		} else if(type == SQLITE_TEXT || type == SQLITE_BLOB) {
+			const char* p = type == SQLITE_TEXT ? (const char*)sqlite3_value_text(argv[i]) : sqlite3_value_blob(argv[i]);
+			int n = sqlite3_value_bytes(argv[i]);
+			sqlite3_str_append(key,(const char*)&n,sizeof(n));
+			if(n)
+				sqlite3_str_append(key,p,n);
+		}
+	}
+	*key_len = sqlite3_str_length(key);
+	if(sqlite3_str_errcode(key)) {
+		sqlite3_free(sqlite3_str_finish(key));
+		return NULL;
+	}
+	return sqlite3_str_finish(key);
+}
+
+#ifdef STATEMENT_VTAB_INCREMENTAL
+// drops the payloads no row refers to anymore from the arena
+static int rows_compact(struct statement_rows* rows) {
+	size_t len = 0, num_values = (size_t)rows->num_rows*rows->num_cols;
+	for(size_t i = 0; i < num_values; i++)
+		if(rows->values[i].type == SQLITE_TEXT || rows->values[i].type == SQLITE_BLOB)
+			len += rows->values[i].n;
+	char* arena = len ? sqlite3_malloc64(len) : NULL;
+	if(len && !arena)
+		return SQLITE_NOMEM;
+	len = 0;
+	for(size_t i = 0; i < num_values; i++)
+		if(rows->values[i].type == SQLITE_TEXT || rows->values[i].type == SQLITE_BLOB) {
+			if(rows->values[i].n)
+				memcpy(arena+len,rows->arena+rows->values[i].u.offset,rows->values[i].n);
+			rows->values[i].u.offset = len;
+			len += rows->values[i].n;
+		}
+	sqlite3_free(rows->arena);
+	rows->arena = arena;
+	rows->arena_len = rows->arena_cap = len;
+	return SQLITE_OK;
+}
+
+static sqlite3_int64 delta_row_key(const struct statement_delta* delta, int row) {
+	const struct statement_rows* rows = &delta->entry->rows;
+	return rows->values[(size_t)row*rows->num_cols + rows->num_cols-1].u.i;
+}
+
+static int delta_home(const struct statement_delta* delta, sqlite3_int64 key) {
+	return (int)(((sqlite3_uint64)key * 0x9e3779b97f4a7c15ull) >> 32) & (delta->num_slots-1);
+}
+
+// the slot of the row with a rowid, or the empty one it would go in
+static int delta_slot(const struct statement_delta* delta, sqlite3_int64 key) {
+	int i = delta_home(delta,key);
+	while(delta->slots[i] && delta_row_key(delta,delta->slots[i]-1) != key)
+		i = (i+1) & (delta->num_slots-1);
+	return i;
+}
+
+// indexes the rows of the result with room for as many again
+static int delta_index(struct statement_delta* delta) {
+	int num_rows = delta->entry->rows.num_rows, num_slots = 16;
+	while(num_slots < num_rows*4)
+		num_slots *= 2;
+	int* slots = sqlite3_malloc64(sizeof(*slots)*num_slots);
+	if(!slots)
+		return SQLITE_NOMEM;
+	memset(slots,0,sizeof(*slots)*num_slots);
+	sqlite3_free(delta->slots);
+	delta->slots = slots;
+	delta->num_slots = num_slots;
+	for(int row = 0; row < num_rows; row++)
+		slots[delta_slot(delta,delta_row_key(delta,row))] = row+1;
+	return SQLITE_OK;
+}
+
+// removes a row, moving the last row in its place. the slots after it that would be looked up through its slot
+// move back into it, so that there's no need for tombstones
+static void delta_remove(struct statement_delta* delta, int slot) {
+	struct statement_rows* rows = &delta->entry->rows;
+	int row = delta->slots[slot]-1, last = rows->num_rows-1, mask = delta->num_slots-1;
+	struct statement_value* values = rows->values + (size_t)row*rows->num_cols;
+	for(int i = 0; i < rows->num_cols; i++)
+		if(values[i].type == SQLITE_TEXT || values[i].type == SQLITE_BLOB)
+			delta->garbage += values[i].n;
+	for(int j = (slot+1) & mask; delta->slots[j]; j = (j+1) & mask)
+		if(((j-delta_home(delta,delta_row_key(delta,delta->slots[j]-1))) & mask) >= ((j-slot) & mask)) {
+			delta->slots[slot] = delta->slots[j];
+			slot = j;
+		}
+	delta->slots[slot] = 0;
+	if(row != last) {
+		delta->slots[delta_slot(delta,delta_row_key(delta,last))] = row+1;
+		memcpy(values,rows->values+(size_t)last*rows->num_cols,sizeof(*values)*rows->num_cols);
+	}
+	rows->num_rows--;
+}
+
+static int delta_key_cmp(const void* a, const void* b) {
+	sqlite3_int64 x = *(const sqlite3_int64*)a, y = *(const sqlite3_int64*)b;
+	return x < y ? -1 : x > y;
+}
+
+// runs the statement again for each rowid written, replacing the row it had yielded for it if any
+static int delta_apply(struct statement_vtab* vtab) {
+	struct statement_delta* delta = vtab->delta;
+	struct statement_rows* rows = &delta->entry->rows;
+	sqlite3_int64 bytes = cache_entry_bytes(delta->entry);
+	int ret = SQLITE_OK;
+	qsort(delta->keys,delta->num_keys,sizeof(*delta->keys),delta_key_cmp);
+	for(int i = 0; ret == SQLITE_OK && i < delta->num_keys; i++) {
+		if(i && delta->keys[i] == delta->keys[i-1])
+			continue;
+		int slot = delta_slot(delta,delta->keys[i]);
+		if(delta->slots[slot])
+			delta_remove(delta,slot);
+		sqlite3_bind_int64(delta->row_stmt,1,delta->keys[i]);
+		if((ret = sqlite3_step(delta->row_stmt)) == SQLITE_ROW && (ret = rows_append(rows,delta->row_stmt)) == SQLITE_OK) {
+			if(rows->num_rows*2 > delta->num_slots)
+				ret = delta_index(delta);
+			else
+				delta->slots[delta_slot(delta,delta->keys[i])] = rows->num_rows;
+		} else if(ret == SQLITE_DONE)
+			ret = SQLITE_OK;
+		sqlite3_reset(delta->row_stmt);
+	}
+	if(ret == SQLITE_OK && delta->garbage > rows->arena_len/2 && (ret = rows_compact(rows)) == SQLITE_OK)
+		delta->garbage = 0;
+	vtab->cache.bytes += cache_entry_bytes(delta->entry)-bytes;
+	if(ret == SQLITE_OK && vtab->cache.bytes > vtab->cache.max_bytes)
+		ret = SQLITE_FULL;
+	return ret;
+}
+
+// runs the statement in full for a new result, kept in the cache as long as it fits
+static int delta_build(struct statement_vtab* vtab) {
+	struct statement_delta* delta = vtab->delta;
+	int key_len;
+	char* key = cache_key(0,NULL,0,NULL,&key_len);
+	struct statement_cache_entry* entry = key ? sqlite3_malloc64(sizeof(*entry)+key_len) : NULL;
+	if(!entry) {
+		sqlite3_free(key);
+		return SQLITE_NOMEM;
+	}
+	memset(entry,0,sizeof(*entry));
+	entry->hash = hash_bytes(key,key_len);
+	entry->refs = 1;
+	entry->generation = vtab->cache.generation;
+	entry->rows.num_cols = vtab->num_outputs+1;
+	entry->key_len = key_len;
+	memcpy(entry->key,key,key_len);
+	sqlite3_free(key);
+
+	sqlite3_stmt* stmt = NULL;
+	int ret = sqlite3_prepare_v2(vtab->db,delta->keyed_sql,-1,&stmt,NULL);
+	while(ret == SQLITE_OK && (ret = sqlite3_step(stmt)) == SQLITE_ROW)
+		if((ret = rows_append(&entry->rows,stmt)) == SQLITE_OK && cache_entry_bytes(entry) > vtab->cache.max_bytes)
+			ret = SQLITE_FULL;
+	sqlite3_finalize(stmt);
+	if(ret == SQLITE_DONE) {
+		delta->entry = entry;
+		delta->garbage = 0;
+		if((ret = delta_index(delta)) == SQLITE_OK) {
+			entry->refs++;
+			cache_insert(&vtab->cache,entry);
+			return SQLITE_OK;
+		}
+		delta->entry = NULL;
+	}
+	cache_entry_unref(entry);
+	return ret == SQLITE_NOMEM ? ret : SQLITE_OK;
+}
+
+// the data and schema versions of the databases, which the writes of this connection leave be unlike those of others
+// and changes to the schema, neither of which the hook is told about. reading them starts a read transaction too
+static int delta_versions(sqlite3* db, sqlite3_str* versions) {
+	int ret = SQLITE_OK;
+	const char* name;
+	for(int i = 0; ret == SQLITE_OK && (name = sqlite3_db_name(db,i)); i++) {
+		char* sql = sqlite3_mprintf("SELECT d.data_version, s.schema_version FROM \"%w\".pragma_data_version d, \"%w\".pragma_schema_version s",name,name);
+		if(!sql)
+			return SQLITE_NOMEM;
+		sqlite3_stmt* stmt = NULL;
+		if((ret = sqlite3_prepare_v2(db,sql,-1,&stmt,NULL)) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW)
+			sqlite3_str_appendf(versions,"%d:%s=%lld,%lld;",(int)strlen(name),name,sqlite3_column_int64(stmt,0),sqlite3_column_int64(stmt,1));
+		if(ret == SQLITE_OK)
+			ret = sqlite3_finalize(stmt);
+		else
+			sqlite3_finalize(stmt);
+		sqlite3_free(sql);
+	}
+	return ret;
+}
+
+// brings the result up to date with the rowids written since it was last read, or runs the statement again in full
+// where others or schema changes may have touched it, too many rows were written, or cursors are still reading it
+static int delta_refresh(struct statement_vtab* vtab, int changed, char* others, int others_len) {
+	struct statement_delta* delta = vtab->delta;
+	int ret = SQLITE_OK;
+	if(delta->entry) {
+		int own = delta->others && others_len == delta->others_len && !memcmp(others,delta->others,others_len);
+		int kept = cache_find(&vtab->cache,delta->entry->key,delta->entry->key_len,delta->entry->hash) == delta->entry;
+		if(!kept || ((changed || delta->num_keys || delta->overflow || !own)
+				&& (!own || delta->overflow || delta->entry->refs > 2 || (ret = delta_apply(vtab)) != SQLITE_OK))) {
+			cache_clear(&vtab->cache);
+			cache_entry_unref(delta->entry);
+			delta->entry = NULL;
+		}
+	}
+	delta->num_keys = 0;
+	delta->overflow = 0;
+	sqlite3_free(delta->others);
+	delta->others = others;
+	delta->others_len = others_len;
+	if(ret == SQLITE_NOMEM)
+		return ret;
+	return delta->entry ? SQLITE_OK : delta_build(vtab);
+}
+#endif
+
+// a materialized result, or the cache of a table that isn't deterministic, stays valid as long as none of the databases
+// on the connection have changed. their data versions change with each commit by any connection, but sqlite only
+// notices those of others as a read transaction starts on the database, so one is started on any database which isn't
+// in one already (temp is private to us).
+// within a write transaction the connection's own uncommitted changes aren't reflected at all, so the cache isn't used.
+// incrementally materialized tables start the read transactions as they read the versions others change
+static int cache_validate(struct statement_vtab* vtab, int* cached) {
+#ifdef STATEMENT_VTAB_MATERIALIZE
+	sqlite3* db = vtab->db;
+	*cached = 0;
+	if(sqlite3_txn_state(db,NULL) == SQLITE_TXN_WRITE)
+		return SQLITE_OK;
+
+	int ret = SQLITE_OK;
+	sqlite3_str* versions = sqlite3_str_new(NULL);
+	sqlite3_str* others = NULL;
+#ifdef STATEMENT_VTAB_INCREMENTAL
+	if(vtab->delta && (ret = delta_versions(db,others = sqlite3_str_new(NULL))) != SQLITE_OK) {
+		sqlite3_free(sqlite3_str_finish(others));
+		sqlite3_free(sqlite3_str_finish(versions));
+		return ret;
+	}
+#endif
+	const char* name;
+	for(int i = 0; ret == SQLITE_OK && (name = sqlite3_db_name(db,i)); i++) {
+		if(!others && i != 1 && sqlite3_txn_state(db,name) == SQLITE_TXN_NONE) {
+			sqlite3_stmt* stmt = NULL;
+			char* sql = sqlite3_mprintf("PRAGMA \"%w\".data_version",name);
+			if(!sql) {
+				ret = SQLITE_NOMEM;
+				break;
+			}
+			if((ret = sqlite3_prepare_v2(db,sql,-1,&stmt,NULL)) == SQLITE_OK) {
+				sqlite3_step(stmt);
+				ret = sqlite3_finalize(stmt);
+			}
+			sqlite3_free(sql);
+		}
+		unsigned int version = 0;
+		if(sqlite3_file_control(db,name,SQLITE_FCNTL_DATA_VERSION,&version) != SQLITE_OK)
+			version = 0;
+		sqlite3_str_appendf(versions,"%d:%s=%u;",(int)strlen(name),name,version);
+	}
+	int len = sqlite3_str_length(versions);
+	char* current = sqlite3_str_finish(versions);
+	if(ret != SQLITE_OK || !current) {
+		sqlite3_free(current);
+		if(others)
+			sqlite3_free(sqlite3_str_finish(others));
+		return ret != SQLITE_OK ? ret : SQLITE_NOMEM;
+	}
+	int changed = !vtab->data_versions || len != vtab->data_versions_len || memcmp(current,vtab->data_versions,len);
+	if(!changed)
+		sqlite3_free(current);
+	else {
+		if(!others)
+			cache_clear(&vtab->cache);
+		if(vtab->shared_file)
+			shared_changed(vtab->shared_file);
+		sqlite3_free(vtab->data_versions);
+		vtab->data_versions = current;
+		vtab->data_versions_len = len;
+	}
+#ifdef STATEMENT_VTAB_INCREMENTAL
+	if(others) {
+		int others_len = sqlite3_str_length(others);
+		char* other_versions = sqlite3_str_finish(others);
+		if(!other_versions)
+			return SQLITE_NOMEM;
+		if((ret = delta_refresh(vtab,changed,other_versions,others_len)) != SQLITE_OK)
+			return ret;
+		*cached = vtab->delta->entry != NULL;
+		return SQLITE_OK;
+	}
+#endif
+	*cached = 1;
+	return SQLITE_OK;
+#else
+	*cached = 0;
+	return SQLITE_OK;
+#endif
+}
+
+// serve from the cache if these parameters have been seen before, otherwise prepare to record this run.
+// hits and misses of the shared cache are counted by the table as well
+static int statement_cursor_lookup(struct statement_cursor* cur, int idxNum, const char* idxStr, int argc, sqlite3_value** argv) {
+	struct statement_vtab* vtab = (struct statement_vtab*)cur->base.pVtab;
+	struct statement_cache* cache = &vtab->cache;
+	struct statement_shard* shard = NULL;
+	int key_len;
+	char* key = cache_key(idxNum,idxStr,argc,argv,&key_len);
+	if(key && vtab->shared_file)
+		key = shared_key(vtab,idxNum,key,&key_len);
+	if(!key)
+		return SQLITE_NOMEM;
+	sqlite3_uint64 hash = hash_bytes(key,key_len);
+	if(vtab->shared_file) {
+		shard = shared_shard(hash);
+		cache = &shard->cache;
+		sqlite3_mutex_enter(shard->mutex);
+	}
+	if((cur->entry = cache_find(cache,key,key_len,hash))) {
+		vtab->cache.hits++;
+		cache_touch(cache,cur->entry);
+		cur->entry->refs++;
+		cur->entry_row = 0;
+	} else {
+		vtab->cache.misses++;
+		if((cur->fill = sqlite3_malloc64(sizeof(*cur->fill)+key_len))) {
+			memset(cur->fill,0,sizeof(*cur->fill));
+			cur->fill->hash = hash;
+			cur->fill->refs = 1;
+			cur->fill->generation = cache->generation;
+			cur->fill->rows.num_cols = vtab->num_outputs;
+			cur->fill->key_len = key_len;
+			memcpy(cur->fill->key,key,key_len);
+		}
+	}
+	if(shard)
+		sqlite3_mutex_leave(shard->mutex);
+	sqlite3_free(key);
+	return SQLITE_OK;
+}
+
+// the tuples of a bulk table are a json array of arrays of parameters by position, objects of parameters by name,
+// or plain values for the first parameter. they're read in one pass by sqlite's own json_tree on a statement kept by the cursor
+// position tuples_stmt on the row starting the first tuple, returning SQLITE_DONE if there are none
+static int tuples_start(struct statement_cursor* cur) {
+	struct statement_vtab* vtab = (struct statement_vtab*)cur->base.pVtab;
+	int ret;
+	cur->tuples_done = 0;
+	if(!cur->tuples_stmt && (ret = sqlite3_prepare_v3(vtab->db,"SELECT key, value, type, id, parent FROM json_tree(?1)",-1,
+		SQLITE_PREPARE_PERSISTENT,&cur->tuples_stmt,NULL)) != SQLITE_OK)
+		goto error;
+	sqlite3_reset(cur->tuples_stmt);
+	if((ret = sqlite3_bind_value(cur->tuples_stmt,1,cur->tuples)) != SQLITE_OK)
+		return ret;
+	if((ret = sqlite3_step(cur->tuples_stmt)) == SQLITE_DONE)
+		return ret;
+	if(ret != SQLITE_ROW)
+		goto error;
+	if(strcmp((const char*)sqlite3_column_text(cur->tuples_stmt,2),"array")) {
+		sqlite3_reset(cur->tuples_stmt);
+		sqlite3_free(vtab->base.zErrMsg);
+		vtab->base.zErrMsg = sqlite3_mprintf("tuples of %s must be a json array",vtab->name);
+		return SQLITE_MISMATCH;
+	}
+	cur->tuples_root = sqlite3_column_int64(cur->tuples_stmt,3);
+	if((ret = sqlite3_step(cur->tuples_stmt)) == SQLITE_ROW || ret == SQLITE_DONE)
+		return ret;
+
+error:
+	sqlite3_free(vtab->base.zErrMsg);
+	vtab->base.zErrMsg = sqlite3_mprintf("%s",sqlite3_errmsg(vtab->db));
+	return ret;
+}
+
+#ifdef STATEMENT_VTAB_PARALLEL
+// read every tuple into a job of its own, or leave tuples_stmt on the first one again to run them serially
+static int batch_tuples(struct statement_cursor* cur) {
+	sqlite3_snapshot* snapshot;
+	if(!parallel_ready(cur,&snapshot))
+		return SQLITE_OK;
+	struct statement_batch* batch = batch_new(cur,snapshot);
+	if(!batch)
+		return SQLITE_NOMEM;
+	batch->tuples = 1;
+	int ret = SQLITE_ROW;
+	while(!cur->tuples_done && batch->num_jobs < STATEMENT_VTAB_PARALLEL_MAX_JOBS) {
+		struct statement_job* job = batch_job(batch);
+		if(!job) {
+			ret = SQLITE_NOMEM;
+			break;
+		}
+		if((ret = tuple_bind(cur,job->values)) != SQLITE_ROW)
+			break;
+		job->ordinal = cur->ordinal;
+	}
+	if(ret == SQLITE_ROW && cur->tuples_done && batch->num_jobs >= 2)
+		return batch_run(cur,batch);
+	batch_free(batch);
+	if(ret != SQLITE_ROW)
+		return ret;
+	return (ret = tuples_start(cur)) == SQLITE_ROW ? SQLITE_OK : ret;
+}
+#endif
+
+static int bulk_filter(struct statement_cursor* cur, int argc, sqlite3_value** argv) {
+	struct statement_vtab* vtab = (struct statement_vtab*)cur->base.pVtab;
+	vtab->stats.filters++;
+	cur->tuples = argc ? argv[0] : NULL;
+	// without any tuples the statement isn't run at all, leaving the cursor at eof
+	int ret;
+	if((ret = tuples_start(cur)) != SQLITE_ROW)
+		return ret == SQLITE_DONE ? SQLITE_OK : ret;
+#ifdef STATEMENT_VTAB_PARALLEL
+	if((ret = batch_tuples(cur)) != SQLITE_OK || cur->batch)
+		return ret;
+#endif
+	if((ret = tuple_bind(cur,NULL)) != SQLITE_ROW)
+		return ret;
+	return statement_cursor_start(cur);
+}
+
+// xBestIndex needs to communicate which columns are constrained by the where clause to xFilter;
+// in terms of a statement table this translates to which parameters will be available to bind.
+static int statement_cursor_filter(sqlite3_vtab_cursor* cur, int idxNum, const char* idxStr, int argc, sqlite3_value** argv) {
+	struct statement_cursor* stmtcur = (struct statement_cursor*)cur;
+	struct statement_vtab* vtab = (struct statement_vtab*)cur->pVtab;
+	stmtcur->rowid = 1;
+#ifdef STATEMENT_VTAB_PARALLEL
+	batch_finish(stmtcur);
+#endif
+	run_end(stmtcur,0);
+	stmtcur->observed = -1;
+	cache_entry_unref(stmtcur->entry);
+	cache_entry_unref(stmtcur->fill);
+	stmtcur->entry = stmtcur->fill = NULL;
+	in_clear(stmtcur);
+
+	int ret;
+	if(idxNum < 0 || idxNum >= vtab->program->num_variants)
+		return SQLITE_INTERNAL;
+	if(idxNum != stmtcur->variant || !stmtcur->stmt) {
+		if(stmtcur->stmt)
+			statement_release(vtab,stmtcur->variant,stmtcur->stmt);
+		stmtcur->stmt = NULL;
+		if((ret = statement_acquire(vtab,idxNum,&stmtcur->stmt)) != SQLITE_OK)
+			return ret;
+		stmtcur->variant = idxNum;
+	}
+	sqlite3_stmt* stmt = stmtcur->stmt;
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+	if(vtab->bulk)
+		return bulk_filter(stmtcur,argc,argv);
+
+	// these seem to persist for the remainder of the statement, so just shallow copy
+	if(vtab->num_inputs)
+		memset(stmtcur->param_argv,0,sizeof(*stmtcur->param_argv)*vtab->num_inputs);
+	for(int i = 0; i < argc; i++) {
+		int param = idxStr?((int*)idxStr)[i]:i+1;
+		if(param > 0 && param <= vtab->num_inputs)
+			stmtcur->param_argv[param-1] = argv[i];
+	}
+
+	vtab->stats.filters++;
+	int cached = vtab->cache.max_bytes != 0;
+	if((vtab->materialize || (cached && !vtab->deterministic)) && (ret = cache_validate(vtab,&cached)) != SQLITE_OK)
+		return ret;
+	if(cached && (ret = statement_cursor_lookup(stmtcur,idxNum,idxStr,argc,argv)) != SQLITE_OK)
+		return ret;
+	if(stmtcur->entry) {
+		if(stmtcur->entry->rows.num_rows)
+			vtab->stats.rows++;
+		return SQLITE_OK;
+	}
+
+	// parameters mapped to negative indexes are bound to each value of an IN constraint in turn
+	int empty = 0;
+	for(int i = 0; i < argc; i++) {
+		int param = idxStr?((int*)idxStr)[i]:i+1;
+		if(param > 0) {
+			if((ret = sqlite3_bind_value(stmt,param,argv[i])) != SQLITE_OK)
+				return ret;
+			continue;
+		}
+#ifdef STATEMENT_VTAB_IN
+		if(stmtcur->in_len == stmtcur->in_cap) {
+			struct statement_in* in = sqlite3_realloc64(stmtcur->in,sizeof(*in)*(stmtcur->in_cap+argc));
+			if(!in)
+				return SQLITE_NOMEM;
+			stmtcur->in = in;
+			stmtcur->in_cap += argc;
+		}
+		struct statement_in* in = &stmtcur->in[stmtcur->in_len++];
+		memset(in,0,sizeof(*in));
+		in->param = -param;
+		if((ret = in_load(in,argv[i])) != SQLITE_OK)
+			return ret;
+		if(!in->num_values)
+			empty = 1;
+		else if((ret = in_bind(stmtcur,stmtcur->in_len-1)) != SQLITE_OK)
+			return ret;
+#else
+		return SQLITE_INTERNAL;
+#endif
+	}
 
-	vtab->db = db;
-	vtab->sql_len = len-2;
-	if(!(vtab->sql = sqlite3_mprintf("%.*s",vtab->sql_len,argv[3]+1))) {
-		ret = SQLITE_NOMEM;
-		goto error;
+	if(vtab->feedback) {
+		sqlite3_uint64 params = 0;
+		for(int i = 0; i < argc; i++) {
+			int param = idxStr?((int*)idxStr)[i]:i+1;
+			if(param < 0)
+				param = -param;
+			if(param <= vtab->num_inputs)
+				params |= param_bit(param);
+		}
+		stmtcur->observed = observed_find(vtab,idxNum,params,1);
 	}
 
-	sqlite3_mutex_enter(mutex);
-	if((ret = sqlite3_prepare_v2(db,vtab->sql,vtab->sql_len,&stmt,NULL)) != SQLITE_OK)
-		goto sqlite_error;
-	sqlite3_mutex_leave(mutex);
-	if(!sqlite3_stmt_readonly(stmt)) {
-		ret = SQLITE_ERROR;
-		if(!(*pzErr = sqlite3_mprintf("Statement must be read only.")))
-			ret = SQLITE_NOMEM;
-		goto error;
+	// with nothing to match an IN constraint the statement isn't run at all, leaving the cursor at eof
+	if(!empty) {
+#ifdef STATEMENT_VTAB_PARALLEL
+		if(stmtcur->in_len && !stmtcur->fill && ((ret = batch_in(stmtcur,idxStr,argc,argv)) != SQLITE_OK || stmtcur->batch))
+			return ret;
+#endif
+		return statement_cursor_start(stmtcur);
 	}
+	return SQLITE_OK;
+}
 
-	vtab->num_inputs = sqlite3_bind_parameter_count(stmt);
-	vtab->num_outputs = sqlite3_column_count(stmt);
+// the vm instructions the statement of the cursor took since the budget began, counted from the first look at it
+// should xFilter have taken up another statement meanwhile. sqlite only adds up those of a step once it returns,
+// firing the handler in the meantime whenever the count it started from plus those of the step reaches a multiple of
+// the interval, which is how those of the step running now are made out
+static sqlite3_int64 budget_steps_used(struct statement_budget* budget, int fired) {
+	sqlite3_stmt* stmt = budget->cur->stmt;
+	if(!stmt)
+		return 0;
+	sqlite3_int64 steps = sqlite3_stmt_status(stmt,SQLITE_STMTSTATUS_VM_STEP,0);
+	if(stmt != budget->stmt) {
+		budget->stmt = stmt;
+		budget->start = steps;
+	}
+	if(steps != budget->seen) {
+		budget->seen = steps;
+		budget->fired = 0;
+	}
+	budget->fired += fired;
+	return steps-budget->start + (budget->fired ? budget->fired*budget->interval - steps%budget->interval : 0);
+}
 
-	if(!(create = build_create_statement(stmt))) {
-		ret = SQLITE_NOMEM;
-		goto error;
+// the progress handler while a call with a budget runs, checking its budget and those of the calls it runs within,
+// and calling the application's own handler about as often as it asked for
+static int budget_progress(void* p) {
+	struct statement_budget* budget = p;
+	struct statement_vtab_context* context = budget->context;
+	sqlite3_int64 now = 0, steps = 0;
+	for(struct statement_budget* b = budget; b; b = b->outer) {
+		// outer calls are waiting on this one, with the handler only firing for its step
+		steps += budget_steps_used(b,b == budget)+b->nested;
+		if(b->steps >= 0 && steps >= b->steps)
+			b->exceeded = 1;
+		if(b->deadline) {
+			if(!now)
+				now = clock_ns();
+			if(now >= b->deadline)
+				b->exceeded = 1;
+		}
+		if(b->exceeded)
+			return 1;
 	}
-	sqlite3_mutex_enter(mutex);
-	if((ret = sqlite3_declare_vtab(db,create)) != SQLITE_OK)
-		goto sqlite_error;
-	sqlite3_mutex_leave(mutex);
+	if(context->progress && (context->progress_count += budget->interval) >= context->progress_ops) {
+		context->progress_count = 0;
+		return context->progress(context->progress_arg);
+	}
+	return 0;
+}
 
-	sqlite3_free(create);
-	sqlite3_finalize(stmt);
+static void budget_begin(struct statement_cursor* cur, struct statement_budget* budget) {
+	struct statement_vtab* vtab = (struct statement_vtab*)cur->base.pVtab;
+	struct statement_vtab_context* context = vtab->context;
+	budget->context = context;
+	budget->outer = context->budget;
+	budget->cur = cur;
+	budget->stmt = cur->stmt;
+	budget->start = budget->seen = cur->stmt ? sqlite3_stmt_status(cur->stmt,SQLITE_STMTSTATUS_VM_STEP,0) : 0;
+	budget->fired = budget->nested = 0;
+	budget->steps = vtab->budget_steps ? vtab->budget_steps : -1;
+	budget->deadline = vtab->budget_ns ? clock_ns()+vtab->budget_ns : 0;
+	budget->exceeded = 0;
+	int interval = STATEMENT_VTAB_BUDGET_OPS;
+	if(vtab->budget_steps && vtab->budget_steps < interval)
+		interval = (int)vtab->budget_steps;
+	if(budget->outer && budget->outer->interval < interval)
+		interval = budget->outer->interval;
+	if(context->progress && context->progress_ops < interval)
+		interval = context->progress_ops;
+	budget->interval = interval;
+	context->budget = budget;
+	sqlite3_progress_handler(vtab->db,interval,budget_progress,budget);
+}
+
+// puts back the handler of the call this one ran within, or else the application's, and settles a call that ran out
+// of its budget, failing it with SQLITE_INTERRUPT or with the budget_truncate option ending the rows of the table there.
+// the rows a prefetch buffer holds already are still served
+static int budget_end(struct statement_cursor* cur, struct statement_budget* budget, int ret) {
+	struct statement_vtab* vtab = (struct statement_vtab*)cur->base.pVtab;
+	struct statement_vtab_context* context = vtab->context;
+	context->budget = budget->outer;
+	if(budget->outer) {
+		budget->outer->nested += budget_steps_used(budget,0)+budget->nested;
+		sqlite3_progress_handler(vtab->db,budget->outer->interval,budget_progress,budget->outer);
+	} else
+		sqlite3_progress_handler(vtab->db,context->progress_ops,context->progress,context->progress_arg);
+	// an interrupt on behalf of an outer budget or the application is passed on as any other error
+	if(!budget->exceeded || ret != SQLITE_INTERRUPT)
+		return ret;
+	vtab->stats.budget_exceeded++;
+	if(!vtab->budget_truncate) {
+		sqlite3_free(vtab->base.zErrMsg);
+		vtab->base.zErrMsg = sqlite3_mprintf("statement of %s ran out of its budget",vtab->name);
+		return SQLITE_INTERRUPT;
+	}
+	sqlite3_log(SQLITE_WARNING,"statement table %s.%s truncated after running out of its budget",vtab->schema,vtab->name);
+	if(cur->entry && cur->entry != cur->prefetch)
+		cur->entry_row = cur->entry->rows.num_rows;
+	// with no parameters or tuples left to run it again with, the cursor is at eof once the statement is reset
+	sqlite3_reset(cur->stmt);
+	cur->run_done = 1;
+	cur->tuples_done = 1;
+	for(int i = 0; i < cur->in_len; i++)
+		cur->in[i].at = cur->in[i].num_values-1;
 	return SQLITE_OK;
+}
 
-sqlite_error:
-	if(!(*pzErr = sqlite3_mprintf("%s",sqlite3_errmsg(db))))
-		ret = SQLITE_NOMEM;
-	sqlite3_mutex_leave(mutex);
-error:
-	sqlite3_free(create);
-	sqlite3_finalize(stmt);
-	statement_vtab_destroy(*ppVtab);
-	*ppVtab = NULL;
-	return ret;
+static int statement_vtab_filter(sqlite3_vtab_cursor* cur, int idxNum, const char* idxStr, int argc, sqlite3_value** argv) {
+	struct statement_vtab* vtab = (struct statement_vtab*)cur->pVtab;
+	if(!vtab->budget_steps && !vtab->budget_ns)
+		return statement_cursor_filter(cur,idxNum,idxStr,argc,argv);
+	sqlite3_free(vtab->base.zErrMsg);
+	vtab->base.zErrMsg = NULL;
+	int ret = budget_usable(vtab,&vtab->base.zErrMsg);
+	if(ret != SQLITE_OK)
+		return ret;
+	struct statement_budget budget;
+	budget_begin((struct statement_cursor*)cur,&budget);
+	return budget_end((struct statement_cursor*)cur,&budget,statement_cursor_filter(cur,idxNum,idxStr,argc,argv));
 }
 
-// if these point to the literal same function sqlite makes statement_vtab eponymous, which we don't want
-static int statement_vtab_connect(sqlite3* db, void* pAux, int argc, const char* const* argv, sqlite3_vtab** ppVtab, char** pzErr) {
-	return statement_vtab_create(db,pAux,argc,argv,ppVtab,pzErr);
+static int statement_vtab_next(sqlite3_vtab_cursor* cur) {
+	struct statement_vtab* vtab = (struct statement_vtab*)cur->pVtab;
+	if(!vtab->budget_steps && !vtab->budget_ns)
+		return statement_cursor_next(cur);
+	struct statement_budget budget;
+	budget_begin((struct statement_cursor*)cur,&budget);
+	return budget_end((struct statement_cursor*)cur,&budget,statement_cursor_next(cur));
 }
 
-static int statement_vtab_open(sqlite3_vtab* pVTab, sqlite3_vtab_cursor** ppCursor) {
-	struct statement_vtab* vtab = (struct statement_vtab*)pVTab;
-	struct statement_cursor* cur = sqlite3_malloc64(sizeof(*cur));
-	if(!cur)
-		return SQLITE_NOMEM;
+// whether an output column is read by the query, as given by colUsed where the last bit stands for all columns after it
+static int output_used(sqlite3_uint64 col_used, int i) {
+	return i >= 63 || (col_used & (1ull << i));
+}
 
-	*ppCursor = &cur->base;
-	cur->param_argv = sqlite3_malloc(sizeof(*cur->param_argv)*vtab->num_inputs);
-	return sqlite3_prepare_v2(vtab->db,vtab->sql,vtab->sql_len,&cur->stmt,NULL);
+// rewritten forms of the statement refer to its columns as c0, c1, ... regardless of their names.
+// output columns the query doesn't read are replaced by NULL, sparing their evaluation where sqlite can flatten
+// the statement into the wrapping select
+static void append_wrapped(sqlite3_str* sql, const struct statement_vtab* vtab, sqlite3_uint64 col_used) {
+	sqlite3_str_appendall(sql,"WITH statement_vtab_inner(");
+	for(int i = 0; i < vtab->num_outputs; i++)
+		sqlite3_str_appendf(sql,"%sc%d",i?",":"",i);
+	// keeping the statement on its own line guards against it ending with a comment
+	sqlite3_str_appendf(sql,") AS (\n%s\n) SELECT ",vtab->program->variants[0].sql);
+	int i = 0;
+	while(i < vtab->num_outputs && output_used(col_used,i))
+		i++;
+	if(i == vtab->num_outputs)
+		sqlite3_str_appendall(sql,"*");
+	else for(i = 0; i < vtab->num_outputs; i++)
+		sqlite3_str_appendf(sql,output_used(col_used,i)?"%sc%d":"%sNULL",i?",":"",i);
+	sqlite3_str_appendall(sql," FROM statement_vtab_inner");
 }
 
-static int statement_vtab_close(sqlite3_vtab_cursor* cur){
-	struct statement_cursor* stmtcur = (struct statement_cursor*)cur;
-	sqlite3_finalize(stmtcur->stmt);
-	sqlite3_free(stmtcur->param_argv);
-	sqlite3_free(cur);
-	return SQLITE_OK;
+// checks that the parameters of the statement are still numbered the same in a rewritten form of it
+static int variant_params_match(sqlite3_stmt* stmt, sqlite3_stmt* variant, int num_args) {
+	int num_inputs = sqlite3_bind_parameter_count(stmt);
+	if(sqlite3_bind_parameter_count(variant) != num_inputs+num_args)
+		return 0;
+	for(int i = 1; i <= num_inputs; i++) {
+		const char* a = sqlite3_bind_parameter_name(stmt,i);
+		const char* b = sqlite3_bind_parameter_name(variant,i);
+		if(a && b ? strcmp(a,b) : a != b)
+			return 0;
+	}
+	return 1;
 }
 
-static int statement_vtab_next(sqlite3_vtab_cursor* cur){
-	struct statement_cursor* stmtcur = (struct statement_cursor*)cur;
-	int ret = sqlite3_step(stmtcur->stmt);
-	if(ret == SQLITE_ROW) {
-		stmtcur->rowid++;
-		return SQLITE_OK;
+// finds or adds the variant with the given sql, taking ownership of it; returns the variant index
+// or 0 if it couldn't be used, in which case xBestIndex falls back to the statement as given
+static int variant_lookup(struct statement_vtab* vtab, char* sql, int num_args, int* ret) {
+	*ret = SQLITE_OK;
+	if(!sql) {
+		*ret = SQLITE_NOMEM;
+		return 0;
 	}
-	return ret == SQLITE_DONE ? SQLITE_OK : ret;
+	int sql_len = strlen(sql);
+	for(int i = 1; i < vtab->program->num_variants; i++)
+		if(vtab->program->variants[i].sql_len == sql_len && !memcmp(vtab->program->variants[i].sql,sql,sql_len)) {
+			sqlite3_free(sql);
+			return vtab->program->variants[i].valid ? i : 0;
+		}
+	if(vtab->program->num_variants >= STATEMENT_VTAB_MAX_VARIANTS) {
+		sqlite3_free(sql);
+		return 0;
+	}
+	struct statement_variant* variants = sqlite3_realloc64(vtab->program->variants,sizeof(*variants)*(vtab->program->num_variants+1));
+	if(!variants) {
+		sqlite3_free(sql);
+		*ret = SQLITE_NOMEM;
+		return 0;
+	}
+	vtab->program->variants = variants;
+	int index = vtab->program->num_variants++;
+	struct statement_variant* v = &variants[index];
+	memset(v,0,sizeof(*v));
+	v->sql = sql;
+	v->sql_len = sql_len;
+
+	// prepare it right away to make sure the rewrite works and to seed its pool
+	sqlite3_stmt *stmt = NULL, *base = NULL;
+	if(statement_acquire(vtab,0,&base) == SQLITE_OK && statement_acquire(vtab,index,&stmt) == SQLITE_OK
+		&& variant_params_match(base,stmt,num_args) && estimate_plan(vtab->db,sql,&v->cost,&v->rows,&v->sorted) == SQLITE_OK) {
+		v->valid = 1;
+		statement_release(vtab,index,stmt);
+	} else
+		sqlite3_finalize(stmt);
+	if(base)
+		statement_release(vtab,0,base);
+	return v->valid ? index : 0;
 }
 
-static int statement_vtab_rowid(sqlite3_vtab_cursor* cur, sqlite_int64* pRowid) {
-	*pRowid = ((struct statement_cursor*)cur)->rowid;
-	return SQLITE_OK;
+static void append_order(sqlite3_str* sql, const sqlite3_index_info* index_info) {
+	for(int i = 0; i < index_info->nOrderBy; i++)
+		sqlite3_str_appendf(sql,"%s c%d COLLATE BINARY%s",i?",":" ORDER BY",index_info->aOrderBy[i].iColumn,index_info->aOrderBy[i].desc?" DESC":"");
 }
 
-static int statement_vtab_eof(sqlite3_vtab_cursor* cur) {
-	return !sqlite3_stmt_busy(((struct statement_cursor*)cur)->stmt);
+// keeps one row per distinct combination of the order by columns, any of them being as good as the others to sqlite
+static void append_group(sqlite3_str* sql, const sqlite3_index_info* index_info) {
+	for(int i = 0; i < index_info->nOrderBy; i++)
+		sqlite3_str_appendf(sql,"%s c%d COLLATE BINARY",i?",":" GROUP BY",index_info->aOrderBy[i].iColumn);
 }
 
-static int statement_vtab_column(sqlite3_vtab_cursor* cur, sqlite3_context* ctx, int i) {
-	struct statement_cursor* stmtcur = (struct statement_cursor*)cur;
-	int num_outputs = ((struct statement_vtab*)cur->pVtab)->num_outputs;
-	if(i < num_outputs)
-		sqlite3_result_value(ctx,sqlite3_column_value(stmtcur->stmt,i));
-	else if(i-num_outputs < stmtcur->param_argc)
-		sqlite3_result_value(ctx,stmtcur->param_argv[i-num_outputs]);
-	return SQLITE_OK;
+// whether the query only needs the rows grouped (1), distinct (2) or distinct and in order (3) on the order by columns,
+// or all of them in order (0)
+static int distinct_mode(sqlite3_index_info* index_info) {
+#ifdef STATEMENT_VTAB_DISTINCT
+#ifndef SQLITE_CORE
+	if(sqlite3_libversion_number() < 3038000)
+		return 0;
+#endif
+	return sqlite3_vtab_distinct(index_info);
+#else
+	(void)index_info;
+	return 0;
+#endif
 }
 
-// xBestIndex needs to communicate which columns are constrained by the where clause to xFilter;
-// in terms of a statement table this translates to which parameters will be available to bind.
-static int statement_vtab_filter(sqlite3_vtab_cursor* cur, int idxNum, const char* idxStr, int argc, sqlite3_value** argv) {
-	struct statement_cursor* stmtcur = (struct statement_cursor*)cur;
-	stmtcur->rowid = 1;
-	sqlite3_stmt* stmt = stmtcur->stmt;
-	sqlite3_reset(stmt);
-	sqlite3_clear_bindings(stmt);
+// LIMIT and OFFSET are passed as constraints without a column since 3.38.0
+static int limit_op(unsigned char op) {
+#ifdef SQLITE_INDEX_CONSTRAINT_LIMIT
+	return op == SQLITE_INDEX_CONSTRAINT_LIMIT || op == SQLITE_INDEX_CONSTRAINT_OFFSET;
+#else
+	return 0;
+#endif
+}
 
-	int ret;
-	for(int i = 0; i < argc; i++)
-		if((ret = sqlite3_bind_value(stmt,idxStr?((int*)idxStr)[i]:i+1,argv[i])) != SQLITE_OK)
-			return ret;
-	ret = sqlite3_step(stmt);
-	if(!(ret == SQLITE_ROW || ret == SQLITE_DONE))
-		return ret;
+// the operators that can be applied to an output column within the statement, and whether they take an argument
+static const char* pushdown_op(unsigned char op, int* has_arg) {
+	*has_arg = 1;
+	switch(op) {
+	case SQLITE_INDEX_CONSTRAINT_EQ: return "=";
+	case SQLITE_INDEX_CONSTRAINT_GT: return ">";
+	case SQLITE_INDEX_CONSTRAINT_LE: return "<=";
+	case SQLITE_INDEX_CONSTRAINT_LT: return "<";
+	case SQLITE_INDEX_CONSTRAINT_GE: return ">=";
+	case SQLITE_INDEX_CONSTRAINT_NE: return "<>";
+	case SQLITE_INDEX_CONSTRAINT_IS: return "IS";
+	case SQLITE_INDEX_CONSTRAINT_ISNOT: return "IS NOT";
+	case SQLITE_INDEX_CONSTRAINT_LIKE: return "LIKE";
+	case SQLITE_INDEX_CONSTRAINT_GLOB: return "GLOB";
+	}
+	*has_arg = 0;
+	switch(op) {
+	case SQLITE_INDEX_CONSTRAINT_ISNULL: return "IS NULL";
+	case SQLITE_INDEX_CONSTRAINT_ISNOTNULL: return "IS NOT NULL";
+	}
+	return NULL;
+}
 
-	assert(((struct statement_vtab*)cur->pVtab)->num_inputs >= argc);
-	if((stmtcur->param_argc = argc)) // these seem to persist for the remainder of the statement, so just shallow copy
-		memcpy(stmtcur->param_argv,argv,sizeof(*stmtcur->param_argv)*argc);
+// materialized tables keep to the one result of the statement as given, leaving sqlite to filter and sort it
+static int pushdown_usable(const struct statement_vtab* vtab, const struct sqlite3_index_constraint* constraint) {
+	int has_arg;
+	return !vtab->materialize && constraint->usable && constraint->iColumn >= 0 && constraint->iColumn < vtab->num_outputs && pushdown_op(constraint->op,&has_arg);
+}
 
-	return SQLITE_OK;
+// whether an IN constraint can have all of its values handed to a single xFilter call, and with handle set
+// ask sqlite to do so. the cache is keyed on the values of a single run, so it leaves IN constraints to sqlite
+static int in_all_at_once(const struct statement_vtab* vtab, sqlite3_index_info* index_info, int i, int handle) {
+#ifdef STATEMENT_VTAB_IN
+#ifndef SQLITE_CORE
+	if(sqlite3_libversion_number() < 3038000)
+		return 0;
+#endif
+	if(vtab->cache.max_bytes || index_info->aConstraint[i].op != SQLITE_INDEX_CONSTRAINT_EQ || !sqlite3_vtab_in(index_info,i,-1))
+		return 0;
+	if(handle)
+		sqlite3_vtab_in(index_info,i,1);
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+// finds or keeps a copy of a parameter map, returning NULL if the vtab keeps as many as it may already
+static int* colmap_intern(struct statement_vtab* vtab, const int* map, int len) {
+	for(int i = 0; i < vtab->num_colmaps; i++)
+		if(vtab->colmaps[i]->len == len && !memcmp(vtab->colmaps[i]->map,map,sizeof(*map)*len))
+			return vtab->colmaps[i]->map;
+	if(vtab->num_colmaps >= STATEMENT_VTAB_MAX_COLMAPS)
+		return NULL;
+	struct statement_colmap** colmaps = sqlite3_realloc64(vtab->colmaps,sizeof(*colmaps)*(vtab->num_colmaps+1));
+	if(!colmaps)
+		return NULL;
+	vtab->colmaps = colmaps;
+	struct statement_colmap* colmap = sqlite3_malloc64(sizeof(*colmap)+sizeof(*map)*len);
+	if(!colmap)
+		return NULL;
+	colmap->len = len;
+	memcpy(colmap->map,map,sizeof(*map)*len);
+	colmaps[vtab->num_colmaps++] = colmap;
+	return colmap->map;
+}
+
+// a bulk table needs its tuples to do anything, with the statement run for as many of them as there are in one xFilter call
+static int bulk_best_index(struct statement_vtab* vtab, sqlite3_index_info* index_info) {
+	for(int i = 0; i < index_info->nConstraint; i++)
+		if(index_info->aConstraint[i].iColumn == vtab->num_outputs+1 && index_info->aConstraint[i].usable
+			&& index_info->aConstraint[i].op == SQLITE_INDEX_CONSTRAINT_EQ) {
+			index_info->aConstraintUsage[i].argvIndex = 1;
+			index_info->aConstraintUsage[i].omit = 1;
+			index_info->orderByConsumed = 0;
+			index_info->estimatedCost = vtab->cost * STATEMENT_VTAB_IN_VALUES;
+			index_info->estimatedRows = vtab->rows < ((sqlite3_int64)1 << 56) ? vtab->rows * STATEMENT_VTAB_IN_VALUES : vtab->rows;
+			return SQLITE_OK;
+		}
+	return SQLITE_CONSTRAINT;
 }
 
 static int statement_vtab_best_index(sqlite3_vtab* pVTab, sqlite3_index_info* index_info){
-	int num_outputs = ((struct statement_vtab*)pVTab)->num_outputs;
+	struct statement_vtab* vtab = (struct statement_vtab*)pVTab;
+	if(vtab->bulk)
+		return bulk_best_index(vtab,index_info);
+	int num_outputs = vtab->num_outputs;
 	int out_constraints = 0;
 	index_info->orderByConsumed = 0;
-	index_info->estimatedCost = 1;
-	index_info->estimatedRows = 1;
+	index_info->estimatedCost = vtab->cost;
+	index_info->estimatedRows = vtab->rows;
+	if(vtab->unique)
+		index_info->idxFlags |= SQLITE_INDEX_SCAN_UNIQUE;
 	int col_max = 0;
-	sqlite3_uint64 used_cols = 0;
+	sqlite3_uint64 params = 0;
 	for(int i = 0; i < index_info->nConstraint; i++) {
 		// skip if this is a constraint on one of our output columns
-		if(index_info->aConstraint[i].iColumn < num_outputs)
+		if(index_info->aConstraint[i].iColumn < num_outputs || limit_op(index_info->aConstraint[i].op))
 			continue;
 		// a given query plan is only usable if all provided "input" columns are usable and have equal constraints only
 		// is this redundant / an EQ constraint ever unusable?
 		if(!index_info->aConstraint[i].usable || index_info->aConstraint[i].op != SQLITE_INDEX_CONSTRAINT_EQ)
 			return SQLITE_CONSTRAINT;
 
+		// only one value can be bound per parameter, any further constraints on it are simply checked by sqlite
 		int col_index = index_info->aConstraint[i].iColumn - num_outputs;
+		int j = 0;
+		while(j < i && !(index_info->aConstraint[j].iColumn == index_info->aConstraint[i].iColumn && index_info->aConstraintUsage[j].argvIndex))
+			j++;
+		if(j < i)
+			continue;
 		index_info->aConstraintUsage[i].argvIndex = col_index+1;
 		index_info->aConstraintUsage[i].omit = 1;
 
 		if(col_index+1 > col_max)
 			col_max = col_index+1;
-		if(col_index < 64)
-			used_cols |= 1ull << col_index;
+		params |= param_bit(col_index+1);
 
 		out_constraints++;
 	}
 
+	// constraints on output columns can be applied within a rewritten form of the statement so that they may make use
+	// of indexes, with their values bound to parameters numbered after those of the statement itself
+	sqlite3_str* where = NULL;
+	int num_args = 0, pushed = 0;
+	for(int i = 0; i < index_info->nConstraint; i++) {
+		if(!pushdown_usable(vtab,&index_info->aConstraint[i]))
+			continue;
+		if(!pushed++) {
+			where = sqlite3_str_new(NULL);
+			append_wrapped(where,vtab,index_info->colUsed);
+			sqlite3_str_appendall(where," WHERE ");
+		} else
+			sqlite3_str_appendall(where," AND ");
+		int has_arg;
+		const char* op = pushdown_op(index_info->aConstraint[i].op,&has_arg);
+		sqlite3_str_appendf(where,"c%d %s",index_info->aConstraint[i].iColumn,op);
+		if(has_arg) {
+			int param = vtab->num_inputs + ++num_args;
+			sqlite3_str_appendf(where," ?%d",param);
+			// compare the same way sqlite would have outside of the statement
+			if(op[0] != 'L' && op[0] != 'G')
+				sqlite3_str_appendf(where," COLLATE \"%w\"",sqlite3_vtab_collation(index_info,i));
+			index_info->aConstraintUsage[i].argvIndex = param;
+			if(param > col_max)
+				col_max = param;
+			out_constraints++;
+		}
+		index_info->aConstraintUsage[i].omit = 1;
+	}
+	char* where_sql = NULL;
+	if(where && !(where_sql = sqlite3_str_finish(where)))
+		return SQLITE_NOMEM;
+
+	// an order by on output columns is consumed if the statement yields rows in that order already, or can produce
+	// that order without having to sort where the order by is applied to a variant of it, e.g. by using an index.
+	// whether a sort is needed is decided by sqlite's own query planner on the variant.
+	// running the statement for each value of an IN constraint doesn't keep to any order across those runs however.
+	// where the query only needs distinct rows the variant deduplicates them itself, with the statement's indexes,
+	// and rows only needing to be grouped can be in either direction
+	int ret, variant = 0, num_in = 0;
+	for(int i = 0; i < index_info->nConstraint; i++)
+		if(index_info->aConstraintUsage[i].argvIndex && in_all_at_once(vtab,index_info,i,0))
+			num_in++;
+	int order_by = index_info->nOrderBy > 0 && !num_in, ordered = index_info->nOrderBy <= vtab->order_len;
+	int distinct = order_by ? distinct_mode(index_info) : 0;
+	for(int i = 0; i < index_info->nOrderBy; i++) {
+		if(index_info->aOrderBy[i].iColumn < 0 || index_info->aOrderBy[i].iColumn >= num_outputs)
+			order_by = 0;
+		else if(ordered && (index_info->aOrderBy[i].iColumn != vtab->order[i].column || (distinct != 1 && index_info->aOrderBy[i].desc != vtab->order[i].desc)))
+			ordered = 0;
+	}
+	if(order_by && ordered && !where_sql && distinct < 2)
+		index_info->orderByConsumed = 1;
+	else if(order_by && !vtab->materialize) {
+		sqlite3_str* sql = sqlite3_str_new(NULL);
+		if(where_sql)
+			sqlite3_str_appendall(sql,where_sql);
+		else
+			append_wrapped(sql,vtab,index_info->colUsed);
+		if(distinct >= 2)
+			append_group(sql,index_info);
+		if(distinct != 2)
+			append_order(sql,index_info);
+		variant = variant_lookup(vtab,sqlite3_str_finish(sql),num_args,&ret);
+		if(ret != SQLITE_OK) {
+			sqlite3_free(where_sql);
+			return ret;
+		}
+		// if the statement sorts anyway then it may as well be in the order asked for, though deduplicating
+		// within it still spares the rows from being handed over only to be dropped
+		if(variant && vtab->program->variants[variant].sorted && !ordered && distinct < 2)
+			variant = 0;
+		if(variant)
+			index_info->orderByConsumed = 1;
+	}
+	if(where_sql && !variant) {
+		variant = variant_lookup(vtab,where_sql,num_args,&ret);
+		where_sql = NULL;
+		if(ret != SQLITE_OK)
+			return ret;
+	}
+	sqlite3_free(where_sql);
+
+	if(variant) {
+		index_info->idxNum = variant;
+		if(vtab->program->variants[variant].cost < index_info->estimatedCost)
+			index_info->estimatedCost = vtab->program->variants[variant].cost;
+		if(vtab->program->variants[variant].rows < index_info->estimatedRows)
+			index_info->estimatedRows = vtab->program->variants[variant].rows;
+	} else if(pushed) {
+		for(int i = 0; i < index_info->nConstraint; i++)
+			if(pushdown_usable(vtab,&index_info->aConstraint[i])) {
+				int param = index_info->aConstraintUsage[i].argvIndex;
+				if(param)
+					out_constraints--;
+				index_info->aConstraintUsage[i].argvIndex = 0;
+				index_info->aConstraintUsage[i].omit = 0;
+			}
+		if(col_max > vtab->num_inputs)
+			col_max = vtab->num_inputs;
+	}
+
+	// with nothing else rewritten the statement can still leave out the columns that aren't read, keeping to its own
+	// order where that was consumed. this isn't worth it should a sort be needed that the statement itself avoids
+	int projected = 0;
+	for(int i = 0; i < num_outputs; i++)
+		if(!output_used(index_info->colUsed,i))
+			projected = 1;
+	if(!variant && projected && !vtab->materialize) {
+		sqlite3_str* sql = sqlite3_str_new(NULL);
+		append_wrapped(sql,vtab,index_info->colUsed);
+		if(index_info->orderByConsumed)
+			append_order(sql,index_info);
+		variant = variant_lookup(vtab,sqlite3_str_finish(sql),0,&ret);
+		if(ret != SQLITE_OK)
+			return ret;
+		if(variant && vtab->program->variants[variant].sorted && !vtab->program->variants[0].sorted)
+			variant = 0;
+		index_info->idxNum = variant;
+	}
+
+	int limited_rows = 0;
+#ifdef SQLITE_INDEX_CONSTRAINT_LIMIT
+	// a limit can be applied within the statement too when nothing else would be left for sqlite to filter or sort,
+	// letting it stop early or keep only the top rows while sorting. sqlite still applies the limit and offset itself,
+	// so the statement is limited to the rows up to the end of those instead of skipping the offset
+	int limit = -1, offset = -1, limitable = !num_in && !vtab->materialize && (!index_info->nOrderBy || index_info->orderByConsumed);
+	for(int i = 0; i < index_info->nConstraint && limitable; i++) {
+		if(index_info->aConstraint[i].op == SQLITE_INDEX_CONSTRAINT_LIMIT && index_info->aConstraint[i].usable)
+			limit = i;
+		else if(index_info->aConstraint[i].op == SQLITE_INDEX_CONSTRAINT_OFFSET && index_info->aConstraint[i].usable)
+			offset = i;
+		else if(!index_info->aConstraintUsage[i].omit)
+			limitable = 0;
+	}
+	if(limitable && limit >= 0) {
+		sqlite3_str* sql = sqlite3_str_new(NULL);
+		if(variant)
+			sqlite3_str_appendall(sql,vtab->program->variants[variant].sql);
+		else {
+			append_wrapped(sql,vtab,index_info->colUsed);
+			if(index_info->orderByConsumed)
+				append_order(sql,index_info);
+		}
+		int limit_param = vtab->num_inputs + num_args + 1, offset_param = limit_param + 1;
+		if(offset < 0)
+			sqlite3_str_appendf(sql," LIMIT ?%d",limit_param);
+		else
+			sqlite3_str_appendf(sql," LIMIT CASE WHEN ?%d < 0 THEN -1 ELSE ?%d + max(?%d,0) END",limit_param,limit_param,offset_param);
+		int limited = variant_lookup(vtab,sqlite3_str_finish(sql),num_args+(offset < 0 ? 1 : 2),&ret);
+		if(ret != SQLITE_OK)
+			return ret;
+		if(limited) {
+			variant = index_info->idxNum = limited;
+			index_info->aConstraintUsage[limit].argvIndex = limit_param;
+			out_constraints++;
+			col_max = limit_param;
+			if(offset >= 0) {
+				index_info->aConstraintUsage[offset].argvIndex = offset_param;
+				out_constraints++;
+				col_max = offset_param;
+			}
+
+			// the limit is usually known by now, so the estimate can make use of it
+			sqlite3_value* value = NULL;
+			sqlite3_int64 rows = -1;
+			if(sqlite3_vtab_rhs_value(index_info,limit,&value) == SQLITE_OK && sqlite3_value_type(value) == SQLITE_INTEGER)
+				rows = sqlite3_value_int64(value);
+			if(rows >= 0 && offset >= 0 && sqlite3_vtab_rhs_value(index_info,offset,&value) == SQLITE_OK && sqlite3_value_type(value) == SQLITE_INTEGER && sqlite3_value_int64(value) > 0)
+				rows += sqlite3_value_int64(value);
+			if(rows >= 0 && rows < index_info->estimatedRows) {
+				index_info->estimatedRows = rows;
+				limited_rows = 1;
+			}
+		}
+	}
+#endif
+
+	// what runs of the plan were seen to yield, which a limit known by now may cut short still
+	int observed = vtab->feedback ? observed_find(vtab,index_info->idxNum,params,0) : -1;
+	if(observed >= 0 && vtab->observed[observed].runs >= vtab->feedback) {
+		sqlite3_int64 rows = (sqlite3_int64)(vtab->observed[observed].rows+0.5);
+		if(!vtab->rows_given && (!limited_rows || rows < index_info->estimatedRows))
+			index_info->estimatedRows = rows;
+		if(!vtab->cost_given)
+			index_info->estimatedCost = vtab->observed[observed].vm_steps > 1 ? vtab->observed[observed].vm_steps : 1;
+	}
+
+	// one xFilter call covers every value of an IN constraint, so it costs as much as running the statement for each
+	if(num_in) {
+		num_in = 0;
+		for(int i = 0; i < index_info->nConstraint; i++)
+			if(index_info->aConstraintUsage[i].argvIndex && in_all_at_once(vtab,index_info,i,0)) {
+				index_info->estimatedCost *= STATEMENT_VTAB_IN_VALUES;
+				if(index_info->estimatedRows < ((sqlite3_int64)1 << 56))
+					index_info->estimatedRows *= STATEMENT_VTAB_IN_VALUES;
+				num_in++;
+			}
+		if(num_in)
+			index_info->idxFlags &= ~SQLITE_INDEX_SCAN_UNIQUE;
+	}
+
 	// if the constrained columns are contiguous then we can just tell sqlite to order the arg vector provided to xFilter
 	// in the same order as our column bindings, so there's no need to map between these
 	// (this will always be the case when calling the vtab as a table-valued function)
-	// only support this optimization for up to 64 constrained columns since checking for continuity more generally would cost as much
-	// as just allocating the mapping
-	sqlite_uint64 required_cols = (col_max < 64 ? 1ull << col_max : 0ull)-1;
-	if(!out_constraints || (col_max <= 64 && used_cols == required_cols))
+	// no parameter is given more than one constraint, so they're contiguous exactly when there are as many as the highest
+	if(!out_constraints || (!num_in && out_constraints == col_max))
 		return SQLITE_OK;
 
 	// otherwise map the constraint index as provided to xFilter to column index for bindings
-	// if this is sparse e.g. where arg1 = x and arg3 = y then we store this separately in idxStr
-	int* colmap = sqlite3_malloc64(sizeof(*colmap)*out_constraints);
+	// if this is sparse e.g. where arg1 = x and arg3 = y then we store this separately in idxStr,
+	// and parameters bound to the values of an IN constraint one after another are stored negated.
+	// the same few maps come up again and again as queries are prepared, so they're kept on the vtab and shared
+	int local[16];
+	int* colmap = out_constraints <= (int)(sizeof(local)/sizeof(*local)) ? local : sqlite3_malloc64(sizeof(*colmap)*out_constraints);
 	if(!colmap)
 		return SQLITE_NOMEM;
 
@@ -253,13 +4453,25 @@ static int statement_vtab_best_index(sqlite3_vtab* pVTab, sqlite3_index_info* in
 	int old_index;
 	for(int i = 0; i < index_info->nConstraint; i++)
 		if((old_index = index_info->aConstraintUsage[i].argvIndex)) {
-			colmap[argc] = old_index;
+			colmap[argc] = in_all_at_once(vtab,index_info,i,1) ? -old_index : old_index;
 			index_info->aConstraintUsage[i].argvIndex = ++argc;
 		}
 
-	index_info->idxStr = (char*)colmap;
-	index_info->needToFreeIdxStr = 1;
-
+	// a plan gets a map of its own once the vtab has as many as it keeps
+	int* shared = colmap_intern(vtab,colmap,argc);
+	if(!shared && colmap == local) {
+		if(!(colmap = sqlite3_malloc64(sizeof(*colmap)*argc)))
+			return SQLITE_NOMEM;
+		memcpy(colmap,local,sizeof(*colmap)*argc);
+	}
+	if(shared) {
+		if(colmap != local)
+			sqlite3_free(colmap);
+		index_info->idxStr = (char*)shared;
+	} else {
+		index_info->idxStr = (char*)colmap;
+		index_info->needToFreeIdxStr = 1;
+	}
 	return SQLITE_OK;
 }
 
@@ -268,7 +4480,7 @@ static sqlite3_module statement_vtab_module = {
 	.xConnect    = statement_vtab_connect,
 	.xBestIndex  = statement_vtab_best_index,
 	.xDisconnect = statement_vtab_destroy,
-	.xDestroy    = statement_vtab_destroy,
+	.xDestroy    = statement_vtab_drop,
 	.xOpen       = statement_vtab_open,
 	.xClose      = statement_vtab_close,
 	.xFilter     = statement_vtab_filter,
@@ -276,9 +4488,483 @@ static sqlite3_module statement_vtab_module = {
 	.xEof        = statement_vtab_eof,
 	.xColumn     = statement_vtab_column,
 	.xRowid      = statement_vtab_rowid,
+	.xRename     = statement_vtab_rename,
+#if SQLITE_VERSION_NUMBER >= 3026000
+	.iVersion    = 3,
+	.xShadowName = statement_vtab_shadow_name,
+#endif
+};
+
+// statement_vtab_stats is an eponymous table with a row of counters per statement table on the connection
+enum {
+	STATS_SCHEMA,
+	STATS_NAME,
+	STATS_SQL,
+	STATS_PREPARES,
+	STATS_OPENS,
+	STATS_FILTERS,
+	STATS_ROWS,
+	STATS_STEP_NS,
+	STATS_MAX_STEP_NS,
+	STATS_FULLSCAN_STEPS,
+	STATS_SORTS,
+	STATS_AUTOINDEXES,
+	STATS_VM_STEPS,
+	STATS_MEM_USED,
+	STATS_CACHE_HITS,
+	STATS_CACHE_MISSES,
+	STATS_CACHE_EVICTIONS,
+	STATS_BUDGET_EXCEEDED,
+	STATS_SHARED_BYTES,
+	STATS_SHARED_EVICTIONS
+};
+
+struct stats_vtab {
+	sqlite3_vtab base;
+	struct statement_vtab_context* context;
+};
+
+struct stats_cursor {
+	sqlite3_vtab_cursor base;
+	struct statement_vtab* vtab;
+	sqlite3_int64 rowid;
+};
+
+static int stats_connect(sqlite3* db, void* pAux, int argc, const char* const* argv, sqlite3_vtab** ppVtab, char** pzErr) {
+	int ret = sqlite3_declare_vtab(db,"CREATE TABLE x(schema TEXT, name TEXT, sql TEXT, prepares INT, opens INT, filters INT, "
+		"rows INT, step_ns INT, max_step_ns INT, fullscan_steps INT, sorts INT, autoindexes INT, vm_steps INT, mem_used INT, "
+		"cache_hits INT, cache_misses INT, cache_evictions INT, budget_exceeded INT, shared_bytes INT, shared_evictions INT)");
+	if(ret != SQLITE_OK)
+		return ret;
+	struct stats_vtab* vtab = sqlite3_malloc64(sizeof(*vtab));
+	if(!vtab)
+		return SQLITE_NOMEM;
+	memset(vtab,0,sizeof(*vtab));
+	vtab->context = pAux;
+	*ppVtab = &vtab->base;
+	return SQLITE_OK;
+}
+
+static int stats_disconnect(sqlite3_vtab* pVTab) {
+	sqlite3_free(pVTab);
+	return SQLITE_OK;
+}
+
+static int stats_best_index(sqlite3_vtab* pVTab, sqlite3_index_info* index_info) {
+	index_info->estimatedCost = STATEMENT_VTAB_VTAB_ROWS;
+	index_info->estimatedRows = STATEMENT_VTAB_VTAB_ROWS;
+	return SQLITE_OK;
+}
+
+static int stats_open(sqlite3_vtab* pVTab, sqlite3_vtab_cursor** ppCursor) {
+	struct stats_cursor* cur = sqlite3_malloc64(sizeof(*cur));
+	if(!cur)
+		return SQLITE_NOMEM;
+	memset(cur,0,sizeof(*cur));
+	((struct stats_vtab*)pVTab)->context->timing = 1;
+	*ppCursor = &cur->base;
+	return SQLITE_OK;
+}
+
+static int stats_close(sqlite3_vtab_cursor* cur) {
+	sqlite3_free(cur);
+	return SQLITE_OK;
+}
+
+static int stats_filter(sqlite3_vtab_cursor* cur, int idxNum, const char* idxStr, int argc, sqlite3_value** argv) {
+	struct stats_cursor* statscur = (struct stats_cursor*)cur;
+	statscur->vtab = ((struct stats_vtab*)cur->pVtab)->context->vtabs;
+	statscur->rowid = 1;
+	return SQLITE_OK;
+}
+
+static int stats_next(sqlite3_vtab_cursor* cur) {
+	struct stats_cursor* statscur = (struct stats_cursor*)cur;
+	statscur->vtab = statscur->vtab->next;
+	statscur->rowid++;
+	return SQLITE_OK;
+}
+
+static int stats_eof(sqlite3_vtab_cursor* cur) {
+	return !((struct stats_cursor*)cur)->vtab;
+}
+
+static int stats_rowid(sqlite3_vtab_cursor* cur, sqlite_int64* pRowid) {
+	*pRowid = ((struct stats_cursor*)cur)->rowid;
+	return SQLITE_OK;
+}
+
+static int stats_column(sqlite3_vtab_cursor* cur, sqlite3_context* ctx, int i) {
+	struct statement_vtab* vtab = ((struct stats_cursor*)cur)->vtab;
+	const struct statement_stats* stats = &vtab->stats;
+	sqlite3_int64 mem_used = 0, shared = 0;
+	switch(i) {
+	case STATS_SCHEMA:
+		sqlite3_result_text(ctx,vtab->schema,-1,SQLITE_TRANSIENT);
+		break;
+	case STATS_NAME:
+		sqlite3_result_text(ctx,vtab->name,-1,SQLITE_TRANSIENT);
+		break;
+	case STATS_SQL:
+		sqlite3_result_text(ctx,vtab->sql,vtab->sql_len,SQLITE_TRANSIENT);
+		break;
+	case STATS_PREPARES:
+		sqlite3_result_int64(ctx,stats->prepares);
+		break;
+	case STATS_OPENS:
+		sqlite3_result_int64(ctx,stats->opens);
+		break;
+	case STATS_FILTERS:
+		sqlite3_result_int64(ctx,stats->filters);
+		break;
+	case STATS_ROWS:
+		sqlite3_result_int64(ctx,stats->rows);
+		break;
+	case STATS_STEP_NS:
+		sqlite3_result_int64(ctx,stats->step_ns);
+		break;
+	case STATS_MAX_STEP_NS:
+		sqlite3_result_int64(ctx,stats->max_step_ns);
+		break;
+	case STATS_FULLSCAN_STEPS:
+	case STATS_SORTS:
+	case STATS_AUTOINDEXES:
+	case STATS_VM_STEPS:
+		sqlite3_result_int64(ctx,stats->status[i-STATS_FULLSCAN_STEPS]);
+		break;
+	case STATS_MEM_USED:
+		// memory held by the statements kept for reuse, as those in use by cursors change as they run
+		for(int j = 0; j < vtab->program->num_variants; j++)
+			for(int k = 0; k < vtab->program->variants[j].pool_len; k++)
+				mem_used += sqlite3_stmt_status(vtab->program->variants[j].pool[k],SQLITE_STMTSTATUS_MEMUSED,0);
+		sqlite3_result_int64(ctx,mem_used + vtab->cache.bytes);
+		break;
+	case STATS_CACHE_HITS:
+		sqlite3_result_int64(ctx,vtab->cache.hits);
+		break;
+	case STATS_CACHE_MISSES:
+		sqlite3_result_int64(ctx,vtab->cache.misses);
+		break;
+	case STATS_CACHE_EVICTIONS:
+		sqlite3_result_int64(ctx,vtab->cache.evictions);
+		break;
+	case STATS_BUDGET_EXCEEDED:
+		sqlite3_result_int64(ctx,vtab->stats.budget_exceeded);
+		break;
+	case STATS_SHARED_BYTES:
+	case STATS_SHARED_EVICTIONS:
+		// those of the shared cache as a whole, for the tables using it
+		if(!vtab->shared_file)
+			break;
+		for(int j = 0; j < STATEMENT_VTAB_SHARED_SHARDS; j++) {
+			sqlite3_mutex_enter(shards[j].mutex);
+			shared += i == STATS_SHARED_BYTES ? shards[j].cache.bytes : shards[j].cache.evictions;
+			sqlite3_mutex_leave(shards[j].mutex);
+		}
+		sqlite3_result_int64(ctx,shared);
+		break;
+	}
+	return SQLITE_OK;
+}
+
+static sqlite3_module stats_module = {
+	.xConnect    = stats_connect,
+	.xBestIndex  = stats_best_index,
+	.xDisconnect = stats_disconnect,
+	.xOpen       = stats_open,
+	.xClose      = stats_close,
+	.xFilter     = stats_filter,
+	.xNext       = stats_next,
+	.xEof        = stats_eof,
+	.xColumn     = stats_column,
+	.xRowid      = stats_rowid,
 };
 
+// statement_vtab_stats_reset([name]) zeroes the counters of the named statement table or of all of them,
+// returning the number of tables reset
+static void stats_reset(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+	struct statement_vtab_context* context = sqlite3_user_data(ctx);
+	const char* name = NULL;
+	if(argc && !(name = (const char*)sqlite3_value_text(argv[0]))) {
+		if(sqlite3_value_type(argv[0]) == SQLITE_NULL)
+			sqlite3_result_int(ctx,0);
+		else
+			sqlite3_result_error_nomem(ctx);
+		return;
+	}
+	sqlite3_int64 num_reset = 0;
+	for(struct statement_vtab* vtab = context->vtabs; vtab; vtab = vtab->next)
+		if(!argc || !sqlite3_stricmp(vtab->name,name)) {
+			memset(&vtab->stats,0,sizeof(vtab->stats));
+			vtab->cache.hits = vtab->cache.misses = vtab->cache.evictions = 0;
+			num_reset++;
+		}
+	sqlite3_result_int64(ctx,num_reset);
+}
+
+static void context_unref(void* p) {
+	struct statement_vtab_context* context = p;
+	if(--context->refs)
+		return;
+	sqlite3_mutex* mutex = registry_mutex();
+	sqlite3_mutex_enter(mutex);
+	struct statement_vtab_context** prev = &contexts;
+	while(*prev && *prev != context)
+		prev = &(*prev)->next;
+	if(*prev)
+		*prev = context->next;
+	sqlite3_mutex_leave(mutex);
+	sqlite3_free(context);
+}
+
+static void function_free(void* p) {
+	struct statement_function* function = p;
+	struct statement_function** prev = &function->context->functions;
+	while(*prev && *prev != function)
+		prev = &(*prev)->next;
+	if(*prev)
+		*prev = function->next;
+	sqlite3_free(function->name);
+	sqlite3_free(function->schema);
+	sqlite3_free(function->table);
+	context_unref(function->context);
+	sqlite3_free(function);
+}
+
+// runs the statement of the table on the arguments as its parameters, resulting in the first column of its first row
+// or NULL if it yields none
+static void function_call(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+	struct statement_function* function = sqlite3_user_data(ctx);
+	if(!function->vtab) {
+		char* sql = sqlite3_mprintf("SELECT 1 FROM \"%w\".\"%w\"",function->schema,function->table);
+		sqlite3_stmt* stmt = NULL;
+		if(!sql) {
+			sqlite3_result_error_nomem(ctx);
+			return;
+		}
+		sqlite3_prepare_v2(sqlite3_context_db_handle(ctx),sql,-1,&stmt,NULL);
+		sqlite3_finalize(stmt);
+		sqlite3_free(sql);
+		if(!function->vtab) {
+			char* err = sqlite3_mprintf("no such statement table: %s.%s",function->schema,function->table);
+			sqlite3_result_error(ctx,err ? err : "out of memory",-1);
+			sqlite3_free(err);
+			return;
+		}
+	}
+	struct statement_vtab* vtab = function->vtab;
+	sqlite3_stmt* stmt = function->stmt;
+	int ret = SQLITE_OK;
+	if((!stmt || sqlite3_stmt_busy(stmt)) && (ret = statement_acquire(vtab,0,&stmt)) != SQLITE_OK) {
+		sqlite3_result_error(ctx,vtab->base.zErrMsg ? vtab->base.zErrMsg : sqlite3_errmsg(vtab->db),-1);
+		sqlite3_result_error_code(ctx,ret);
+		return;
+	}
+	if(!function->stmt)
+		function->stmt = stmt;
+	vtab->stats.filters++;
+	// every parameter is bound on each call as there are as many arguments as parameters
+	for(int i = 0; i < argc && ret == SQLITE_OK; i++)
+		ret = sqlite3_bind_value(stmt,i+1,argv[i]);
+	if(ret == SQLITE_OK && (ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+		vtab->stats.rows++;
+		result_value(ctx,sqlite3_column_value(stmt,0));
+	}
+	if(ret != SQLITE_ROW && ret != SQLITE_DONE) {
+		sqlite3_result_error(ctx,sqlite3_errmsg(vtab->db),-1);
+		sqlite3_result_error_code(ctx,ret);
+	}
+	if(stmt == function->stmt)
+		sqlite3_reset(stmt);
+	else
+		statement_release(vtab,0,stmt);
+}
+
+// keywords standing for the time the statement runs at
+static const char* const time_words[] = {"CURRENT_TIMESTAMP","CURRENT_DATE","CURRENT_TIME",NULL};
+
+// whether the function can be declared deterministic: its statement mustn't read any table or the time, and may only
+// call functions that are deterministic themselves as far as sqlite's function_list tells
+static int function_deterministic(struct statement_vtab* vtab) {
+	sqlite3_stmt* list = NULL;
+	if(sqlite3_prepare_v2(vtab->db,"SELECT 1 FROM pragma_function_list WHERE name = ?1 COLLATE NOCASE AND NOT flags & 2048",-1,&list,NULL) != SQLITE_OK)
+		return 0;
+	int deterministic = 1, len, type;
+	for(const char* p = sql_next(vtab->sql,&len,&type); deterministic && type != TOKEN_END; ) {
+		const char* word = p;
+		int word_len = len, word_type = type;
+		p = sql_next(p+len,&len,&type);
+		if(word_type != TOKEN_WORD)
+			continue;
+		if(token_is(word,word_len,"FROM") || token_in(word,word_len,time_words))
+			deterministic = 0;
+		else if(type == TOKEN_OTHER && *p == '(') {
+			sqlite3_bind_text(list,1,word,word_len,SQLITE_STATIC);
+			deterministic = sqlite3_step(list) == SQLITE_DONE;
+			sqlite3_reset(list);
+		}
+	}
+	sqlite3_finalize(list);
+	return deterministic;
+}
+
+static int function_register(struct statement_vtab* vtab, char** pzErr) {
+	if(vtab->num_outputs != 1) {
+		if(!(*pzErr = sqlite3_mprintf("function requires a statement with a single column")))
+			return SQLITE_NOMEM;
+		return SQLITE_MISUSE;
+	}
+	struct statement_function* function;
+	for(function = vtab->context->functions; function; function = function->next)
+		if(function->num_args == vtab->num_inputs && !sqlite3_stricmp(function->name,vtab->function))
+			break;
+	int registered = function != NULL;
+	if(!function) {
+		if(!(function = sqlite3_malloc64(sizeof(*function))))
+			return SQLITE_NOMEM;
+		memset(function,0,sizeof(*function));
+		function->context = vtab->context;
+		function->num_args = vtab->num_inputs;
+		if(!(function->name = sqlite3_mprintf("%s",vtab->function))) {
+			sqlite3_free(function);
+			return SQLITE_NOMEM;
+		}
+	}
+	char* schema = sqlite3_mprintf("%s",vtab->schema);
+	char* table = sqlite3_mprintf("%s",vtab->name);
+	if(!schema || !table) {
+		sqlite3_free(schema);
+		sqlite3_free(table);
+		if(!registered) {
+			sqlite3_free(function->name);
+			sqlite3_free(function);
+		}
+		return SQLITE_NOMEM;
+	}
+	sqlite3_free(function->schema);
+	sqlite3_free(function->table);
+	function->schema = schema;
+	function->table = table;
+	function->vtab = vtab;
+	if(registered)
+		return SQLITE_OK;
+
+	// the function holds a reference to the context for as long as sqlite keeps it, releasing it even if registration fails
+	function->context->refs++;
+	int flags = SQLITE_UTF8 | (vtab->deterministic || function_deterministic(vtab) ? SQLITE_DETERMINISTIC : 0);
+#ifdef STATEMENT_VTAB_INNOCUOUS
+	if(vtab->innocuous)
+		flags |= SQLITE_INNOCUOUS;
+#endif
+	int ret = sqlite3_create_function_v2(vtab->db,function->name,function->num_args,flags,function,function_call,NULL,NULL,function_free);
+	if(ret != SQLITE_OK) {
+		if(!(*pzErr = sqlite3_mprintf("%s",sqlite3_errmsg(vtab->db))))
+			ret = SQLITE_NOMEM;
+		return ret;
+	}
+	function->next = vtab->context->functions;
+	vtab->context->functions = function;
+	return SQLITE_OK;
+}
+
+// statement_vtab_plan(name) is the query plan of the statement of a statement table, as plan_describe gives it
+static void plan_function(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+	struct statement_vtab_context* context = sqlite3_user_data(ctx);
+	sqlite3* db = sqlite3_context_db_handle(ctx);
+	const char* name = (const char*)sqlite3_value_text(argv[0]);
+	(void)argc;
+	if(!name) {
+		if(sqlite3_value_type(argv[0]) != SQLITE_NULL)
+			sqlite3_result_error_nomem(ctx);
+		return;
+	}
+	int len = (int)strlen(name);
+	struct statement_vtab* vtab = vtab_lookup(context,db,NULL,0,0,name,len,TOKEN_WORD);
+	if(!vtab) {
+		// tables are only connected to once used
+		char* sql = sqlite3_mprintf("SELECT 1 FROM \"%w\"",name);
+		sqlite3_stmt* stmt = NULL;
+		if(!sql) {
+			sqlite3_result_error_nomem(ctx);
+			return;
+		}
+		sqlite3_prepare_v2(db,sql,-1,&stmt,NULL);
+		sqlite3_finalize(stmt);
+		sqlite3_free(sql);
+		vtab = vtab_lookup(context,db,NULL,0,0,name,len,TOKEN_WORD);
+	}
+	if(!vtab) {
+		char* err = sqlite3_mprintf("no such statement table: %s",name);
+		if(!err) {
+			sqlite3_result_error_nomem(ctx);
+			return;
+		}
+		sqlite3_result_error(ctx,err,-1);
+		sqlite3_free(err);
+		return;
+	}
+	sqlite3_str* plan = sqlite3_str_new(db);
+	int ret = plan_describe(db,vtab->program->variants[0].sql,plan,1);
+	int plan_len = sqlite3_str_length(plan);
+	char* plan_text = sqlite3_str_finish(plan);
+	if(ret == SQLITE_NOMEM)
+		sqlite3_result_error_nomem(ctx);
+	else if(ret != SQLITE_OK)
+		sqlite3_result_error(ctx,sqlite3_errmsg(db),-1);
+	else
+		sqlite3_result_text(ctx,plan_text ? plan_text : "",plan_len,SQLITE_TRANSIENT);
+	sqlite3_free(plan_text);
+}
+
+// sets the progress handler of the connection like sqlite3_progress_handler, for applications with statement tables
+// given budgets, which take over the handler while they run and put back the one set through this afterwards
+void sqlite3_statementvtab_progress_handler(sqlite3* db, int nOps, int (*xProgress)(void*), void* pArg) {
+	int running = 0;
+	sqlite3_mutex* mutex = registry_mutex();
+	sqlite3_mutex_enter(mutex);
+	for(struct statement_vtab_context* context = contexts; context; context = context->next)
+		if(context->db == db) {
+			context->progress_set = 1;
+			context->progress_ops = nOps > 0 && xProgress ? nOps : 0;
+			context->progress = context->progress_ops ? xProgress : NULL;
+			context->progress_arg = pArg;
+			context->progress_count = 0;
+			running |= context->budget != NULL;
+		}
+	sqlite3_mutex_leave(mutex);
+	if(!running)
+		sqlite3_progress_handler(db,nOps,xProgress,pArg);
+}
+
 int sqlite3_statementvtab_init(sqlite3* db, char** pzErrMsg, const sqlite3_api_routines* pApi) {
 	SQLITE_EXTENSION_INIT2(pApi);
-	return sqlite3_create_module(db, "statement", &statement_vtab_module, NULL);
+	if(registry_mutex_setup() != SQLITE_OK)
+		return SQLITE_NOMEM;
+	struct statement_vtab_context* context = sqlite3_malloc64(sizeof(*context));
+	if(!context)
+		return SQLITE_NOMEM;
+	memset(context,0,sizeof(*context));
+	context->db = db;
+	sqlite3_mutex* mutex = registry_mutex();
+	sqlite3_mutex_enter(mutex);
+	context->next = contexts;
+	contexts = context;
+	sqlite3_mutex_leave(mutex);
+	// held until everything is registered, with each registration holding another that sqlite releases even on failure
+	context->refs = 2;
+	int ret = sqlite3_create_module_v2(db,"statement",&statement_vtab_module,context,context_unref);
+	if(ret == SQLITE_OK) {
+		context->refs++;
+		ret = sqlite3_create_module_v2(db,"statement_vtab_stats",&stats_module,context,context_unref);
+	}
+	for(int argc = 0; argc <= 1 && ret == SQLITE_OK; argc++) {
+		context->refs++;
+		ret = sqlite3_create_function_v2(db,"statement_vtab_stats_reset",argc,SQLITE_UTF8,context,stats_reset,NULL,NULL,context_unref);
+	}
+	if(ret == SQLITE_OK) {
+		context->refs++;
+		ret = sqlite3_create_function_v2(db,"statement_vtab_plan",1,SQLITE_UTF8,context,plan_function,NULL,NULL,context_unref);
+	}
+	context_unref(context);
+	return ret;
 }
@@ -0,0 +1,504 @@
+/*
+ * Checks of what statement tables return, run against SQL written out without them where there's an equivalent.
+ * Built with statement_vtab.c compiled into the same program, see the test target of the Makefile.
+ * In the interest of compatibility with SQLite's own license (or rather lack thereof),
+ * the author disclaims copyright to this source code.
+ */
+
+#include "sqlite3.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int sqlite3_statementvtab_init(sqlite3* db, char** pzErrMsg, const sqlite3_api_routines* pApi);
+void sqlite3_statementvtab_progress_handler(sqlite3* db, int nOps, int (*xProgress)(void*), void* pArg);
+
+// databases that have to be files are created as test.db next to the program, removed again before each test
+static char* test_db;
+
+static const char* test_name;
+static int failures;
+
+static void fail(const char* sql, const char* got, const char* expected) {
+	printf("FAIL %s: %s\n  got      %s\n  expected %s\n",test_name,sql,got,expected);
+	failures++;
+}
+
+static void test_db_remove(void) {
+	static const char* const suffixes[] = {"","-wal","-shm","-journal"};
+	for(size_t i = 0; i < sizeof(suffixes)/sizeof(*suffixes); i++) {
+		char* path = sqlite3_mprintf("%s%s",test_db,suffixes[i]);
+		if(path)
+			remove(path);
+		sqlite3_free(path);
+	}
+}
+
+static sqlite3* test_open(const char* path) {
+	sqlite3* db = NULL;
+	char* err = NULL;
+	if(sqlite3_open(path,&db) != SQLITE_OK || sqlite3_statementvtab_init(db,&err,NULL) != SQLITE_OK) {
+		printf("FAIL %s: opening %s: %s\n",test_name,path,err ? err : sqlite3_errmsg(db));
+		exit(1);
+	}
+	return db;
+}
+
+// the rows of a query as columns separated by | and rows by ;, or its error as "error: message"
+static char* query(sqlite3* db, const char* sql) {
+	sqlite3_str* out = sqlite3_str_new(db);
+	sqlite3_stmt* stmt = NULL;
+	const char* tail = sql;
+	int ret = SQLITE_OK;
+	while(ret == SQLITE_OK && *tail) {
+		if((ret = sqlite3_prepare_v2(db,tail,-1,&stmt,&tail)) != SQLITE_OK || !stmt)
+			break;
+		int rows = 0;
+		while((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+			if(rows++)
+				sqlite3_str_appendchar(out,1,';');
+			for(int i = 0; i < sqlite3_column_count(stmt); i++) {
+				const char* value = (const char*)sqlite3_column_text(stmt,i);
+				sqlite3_str_appendf(out,"%s%s",i ? "|" : "",value ? value : "NULL");
+			}
+		}
+		ret = sqlite3_finalize(stmt);
+		stmt = NULL;
+	}
+	if(ret != SQLITE_OK) {
+		sqlite3_str_reset(out);
+		sqlite3_str_appendf(out,"error: %s",sqlite3_errmsg(db));
+	}
+	int error = sqlite3_str_errcode(out);
+	char* result = sqlite3_str_finish(out);
+	if(!error && !result)
+		result = sqlite3_mprintf("");
+	if(!result) {
+		printf("FAIL %s: out of memory\n",test_name);
+		exit(1);
+	}
+	return result;
+}
+
+static void exec(sqlite3* db, const char* sql) {
+	char* err = NULL;
+	if(sqlite3_exec(db,sql,NULL,NULL,&err) != SQLITE_OK) {
+		printf("FAIL %s: %s\n  %s\n",test_name,sql,err);
+		exit(1);
+	}
+}
+
+static void expect(sqlite3* db, const char* sql, const char* expected) {
+	char* got = query(db,sql);
+	if(strcmp(got,expected))
+		fail(sql,got,expected);
+	sqlite3_free(got);
+}
+
+// the rows of a query on statement tables next to those of the same query written out without them
+static void expect_same(sqlite3* db, const char* sql, const char* inline_sql) {
+	char* got = query(db,sql);
+	char* expected = query(db,inline_sql);
+	if(strcmp(got,expected) || !strncmp(expected,"error: ",7))
+		fail(sql,got,expected);
+	sqlite3_free(got);
+	sqlite3_free(expected);
+}
+
+static sqlite3_int64 stat_value(sqlite3* db, const char* table, const char* column) {
+	char* sql = sqlite3_mprintf("SELECT \"%w\" FROM statement_vtab_stats WHERE name = %Q",column,table);
+	char* value = sql ? query(db,sql) : NULL;
+	sqlite3_int64 n = value ? atoll(value) : -1;
+	sqlite3_free(sql);
+	sqlite3_free(value);
+	return n;
+}
+
+static void expect_stat(sqlite3* db, const char* table, const char* column, int positive) {
+	sqlite3_int64 n = stat_value(db,table,column);
+	if(positive ? n <= 0 : n != 0) {
+		char got[32];
+		snprintf(got,sizeof(got),"%lld",(long long)n);
+		fail(column,got,positive ? "> 0" : "0");
+	}
+}
+
+// a thousand rows to scan through
+static const char* rows_setup =
+	"CREATE TABLE t(a INTEGER PRIMARY KEY, b INT, c TEXT);"
+	"WITH RECURSIVE n(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM n WHERE x < 1000) INSERT INTO t SELECT x, x % 37, 'c' || (x % 5) FROM n;";
+
+// progress handler of the application, counting its calls and interrupting once it's been called limit times
+struct progress {
+	int calls;
+	int limit;
+};
+
+static int progress_count(void* p) {
+	struct progress* progress = p;
+	return ++progress->calls >= progress->limit;
+}
+
+// without sqlite3_statementvtab_progress_handler tables with a budget fail, leaving the application's handler alone
+static void test_budget_unset(void) {
+	const char* unset = "error: budget_steps and budget_ms need the progress handler set with sqlite3_statementvtab_progress_handler";
+	sqlite3* db = test_open(test_db);
+	struct progress progress = {0,1 << 30};
+	exec(db,rows_setup);
+	expect(db,"CREATE VIRTUAL TABLE sums USING statement((SELECT sum(b) FROM t), budget_steps=500)",unset);
+	sqlite3_statementvtab_progress_handler(db,0,NULL,NULL);
+	exec(db,"CREATE VIRTUAL TABLE sums USING statement((SELECT sum(b) FROM t), budget_steps=100000)");
+	expect(db,"SELECT * FROM sums","17983");
+	sqlite3_close(db);
+	// connections to a table created with the handler set can't use it until theirs is set too
+	db = test_open(test_db);
+	sqlite3_progress_handler(db,1000,progress_count,&progress);
+	expect(db,"SELECT * FROM sums",unset);
+	progress.calls = 0;
+	expect(db,"SELECT count(*) FROM t, t AS u WHERE t.b < 10","271000");
+	if(!progress.calls)
+		fail("progress handler after a table with a budget","0 calls","> 0");
+	sqlite3_statementvtab_progress_handler(db,1000,progress_count,&progress);
+	expect(db,"SELECT * FROM sums","17983");
+	sqlite3_close(db);
+}
+
+// with the handler set through the extension, budgets are enforced within steps and the handler is put back after
+static void test_budget_set(void) {
+	sqlite3* db = test_open(":memory:");
+	struct progress progress = {0,1 << 30};
+	exec(db,rows_setup);
+	sqlite3_statementvtab_progress_handler(db,1000,progress_count,&progress);
+	exec(db,
+		"CREATE VIRTUAL TABLE firsts USING statement((SELECT a FROM t WHERE a <= 3 OR a+0 = 1000), budget_steps=500, budget_truncate);"
+		"CREATE VIRTUAL TABLE sums USING statement((SELECT sum(u.b) FROM t, t AS u WHERE t.a < 100), budget_steps=500);"
+		"CREATE VIRTUAL TABLE slow USING statement((SELECT sum(u.b) FROM t, t AS u, t AS v WHERE v.a < :n), budget_ms=20);"
+		"CREATE VIRTUAL TABLE outer_f USING statement((SELECT firsts.a FROM t, firsts WHERE t.a <= :n), budget_steps=100000);");
+	expect(db,"SELECT a FROM firsts","1;2;3");
+	expect(db,"SELECT * FROM sums","error: statement of sums ran out of its budget");
+	expect(db,"SELECT * FROM slow(1000)","error: statement of slow ran out of its budget");
+	expect(db,"SELECT count(*) FROM outer_f(2)","6");
+	if(stat_value(db,"firsts","budget_exceeded") != 3)
+		fail("budget_exceeded of firsts","not 3","3");
+	// the handler keeps being called while budgets run, and is in place again after them
+	progress.calls = 0;
+	expect(db,"SELECT count(*) FROM t, t AS u WHERE t.b < 10","271000");
+	if(!progress.calls)
+		fail("progress handler after a budgeted scan","0 calls","> 0");
+	progress.calls = 0;
+	progress.limit = 1;
+	expect(db,"SELECT * FROM slow(1)","error: interrupted");
+	expect(db,"SELECT count(*) FROM t, t AS u WHERE t.b < 10","error: interrupted");
+	sqlite3_statementvtab_progress_handler(db,0,NULL,NULL);
+	expect(db,"SELECT count(*) FROM t, t AS u WHERE t.b < 10","271000");
+	sqlite3_close(db);
+}
+
+// tables connected to from their shadow table follow changes to the names and types of the columns they read
+static void test_schema_changes(void) {
+	sqlite3* db = test_open(test_db);
+	exec(db,
+		"CREATE TABLE t(c INTEGER);"
+		"INSERT INTO t VALUES(1);"
+		"CREATE VIRTUAL TABLE s USING statement((SELECT * FROM t));");
+	sqlite3_close(db);
+	// as long as the schema is the same, connecting leaves preparing the statement to the first scan
+	db = test_open(test_db);
+	expect(db,"SELECT name FROM pragma_table_info('s')","c");
+	expect_stat(db,"s","prepares",0);
+	expect(db,"SELECT c FROM s","1");
+	expect_stat(db,"s","prepares",1);
+	exec(db,"ALTER TABLE t RENAME COLUMN c TO cc;");
+	expect(db,"SELECT cc FROM s","1");
+	sqlite3_close(db);
+	db = test_open(test_db);
+	expect(db,"SELECT name, type FROM pragma_table_info('s')","cc|INTEGER");
+	expect(db,"SELECT cc FROM s","1");
+	exec(db,"DROP TABLE t; CREATE TABLE t(cc TEXT); INSERT INTO t VALUES('x');");
+	sqlite3_close(db);
+	db = test_open(test_db);
+	expect(db,"SELECT name, type FROM pragma_table_info('s')","cc|TEXT");
+	expect(db,"SELECT cc FROM s","x");
+	sqlite3_close(db);
+}
+
+// the cache of a table that isn't deterministic follows writes by this connection and others, and isn't used for
+// what the connection hasn't committed
+static void test_cache_writes(void) {
+	sqlite3* db = test_open(test_db);
+	exec(db,rows_setup);
+	exec(db,"CREATE VIRTUAL TABLE counts USING statement((SELECT count(*) FROM t WHERE b = :b), cache_bytes=65536);");
+	sqlite3* other = test_open(test_db);
+	expect(db,"SELECT * FROM counts(3)","27");
+	expect(db,"SELECT * FROM counts(3)","27");
+	expect_stat(db,"counts","cache_hits",1);
+	exec(db,"INSERT INTO t VALUES(1001, 3, 'new');");
+	expect(db,"SELECT * FROM counts(3)","28");
+	exec(other,"DELETE FROM t WHERE a = 3;");
+	expect(db,"SELECT * FROM counts(3)","27");
+	exec(db,"BEGIN; INSERT INTO t VALUES(1002, 3, 'txn');");
+	expect(db,"SELECT * FROM counts(3)","28");
+	exec(db,"ROLLBACK;");
+	expect(db,"SELECT * FROM counts(3)","27");
+	expect(db,"SELECT * FROM counts(3)","27");
+	sqlite3_close(other);
+	sqlite3_close(db);
+}
+
+// the function of the function option is there once the table is created or connected to, and is only declared
+// deterministic when its statement is
+static void test_function(void) {
+	sqlite3* db = test_open(test_db);
+	exec(db,"CREATE VIRTUAL TABLE hypot USING statement((SELECT sqrt(:x*:x+:y*:y)), function);");
+	expect(db,"SELECT hypot(3, 4)","5.0");
+	// only deterministic functions are allowed in indexes
+	exec(db,
+		"CREATE TABLE p(x, y);"
+		"CREATE VIRTUAL TABLE stamped USING statement((SELECT CURRENT_TIMESTAMP || :x), function);"
+		"CREATE VIRTUAL TABLE dated USING statement((SELECT date(:x, CURRENT_DATE)), function);");
+	exec(db,"CREATE INDEX p_hypot ON p(hypot(x, y));");
+	expect(db,"CREATE INDEX p_stamped ON p(stamped(x))","error: non-deterministic functions prohibited in index expressions");
+	expect(db,"CREATE INDEX p_dated ON p(dated(x))","error: non-deterministic functions prohibited in index expressions");
+	sqlite3_close(db);
+	db = test_open(test_db);
+	expect(db,"SELECT hypot(3, 4)","error: no such function: hypot");
+	expect(db,"SELECT count(*) FROM pragma_table_info('hypot')","1");
+	expect(db,"SELECT hypot(3, 4)","5.0");
+	sqlite3_close(db);
+}
+
+// inlined arguments go where the parameter of their position is used, whichever order the target numbers them in
+static void test_inline_params(void) {
+	sqlite3* db = test_open(":memory:");
+	exec(db,
+		"CREATE VIRTUAL TABLE diff USING statement((SELECT ?2 - ?1 AS d, ? AS e));"
+		"CREATE VIRTUAL TABLE named USING statement((SELECT :b || '-' || :a || '-' || :b AS n));"
+		"CREATE VIRTUAL TABLE calls USING statement((SELECT d, e, n FROM diff(10, 3, 1), named('x', 'y')), inline);");
+	expect(db,"SELECT * FROM calls","-7|1|x-y-x");
+	expect_stat(db,"diff","filters",0);
+	expect_stat(db,"named","filters",0);
+	expect(db,"SELECT d, e, n FROM diff(10, 3, 1), named('x', 'y')","-7|1|x-y-x");
+	sqlite3_close(db);
+}
+
+// connections of a pool take what the registry has only as long as the schema is the same
+static void test_registry_schema_changes(void) {
+	sqlite3* db = test_open(test_db);
+	exec(db,
+		"CREATE TABLE t(c INTEGER);"
+		"INSERT INTO t VALUES(1);"
+		"CREATE VIRTUAL TABLE s USING statement((SELECT * FROM t), registry);");
+	sqlite3* other = test_open(test_db);
+	expect(other,"SELECT name FROM pragma_table_info('s')","c");
+	exec(db,"ALTER TABLE t RENAME COLUMN c TO cc;");
+	sqlite3* pooled = test_open(test_db);
+	expect(pooled,"SELECT name FROM pragma_table_info('s')","cc");
+	expect(pooled,"SELECT cc FROM s","1");
+	sqlite3* again = test_open(test_db);
+	expect(again,"SELECT cc FROM s","1");
+	sqlite3_close(again);
+	sqlite3_close(pooled);
+	sqlite3_close(other);
+	sqlite3_close(db);
+}
+
+// results computed on one connection are served to the others, and the cache keeps to its cap while evicting
+static void test_shared_cache(void) {
+	sqlite3* db = test_open(test_db);
+	exec(db,rows_setup);
+	exec(db,
+		"CREATE VIRTUAL TABLE f USING statement((SELECT a, c FROM t WHERE b = :b), deterministic, cache_shared);"
+		"CREATE VIRTUAL TABLE wide USING statement((SELECT a, replace(hex(zeroblob(50)), '0', c) AS w FROM t WHERE a % 200 = :k),"
+		" cache_bytes=1000000, cache_shared);");
+	sqlite3* other = test_open(test_db);
+	expect_same(db,"SELECT a, c FROM f(5)","SELECT a, c FROM t WHERE b = 5");
+	expect_stat(db,"f","cache_misses",1);
+	expect_same(other,"SELECT a, c FROM f(5)","SELECT a, c FROM t WHERE b = 5");
+	expect_stat(other,"f","cache_hits",1);
+	expect_stat(other,"f","cache_misses",0);
+	expect_stat(other,"f","shared_bytes",1);
+	// a connection to another file has a cache of its own
+	sqlite3* memory = test_open(":memory:");
+	exec(memory,rows_setup);
+	exec(memory,"CREATE VIRTUAL TABLE f USING statement((SELECT a, c FROM t WHERE b = :b), deterministic, cache_shared);");
+	expect_same(memory,"SELECT a, c FROM f(5)","SELECT a, c FROM t WHERE b = 5");
+	expect_stat(memory,"f","cache_hits",0);
+	sqlite3_close(memory);
+	// more than the cache holds, over the two connections, which results keep matching through
+	for(int round = 0; round < 2; round++)
+		for(int k = 0; k < 200; k++) {
+			char* sql = sqlite3_mprintf("SELECT a, w FROM wide(%d)",k);
+			char* inline_sql = sqlite3_mprintf("SELECT a, replace(hex(zeroblob(50)), '0', c) FROM t WHERE a %% 200 = %d",k);
+			expect_same(round ? other : db,sql,inline_sql);
+			sqlite3_free(sql);
+			sqlite3_free(inline_sql);
+		}
+	expect_stat(db,"wide","shared_evictions",1);
+	expect_same(db,"SELECT a, w FROM wide(199)","SELECT a, replace(hex(zeroblob(50)), '0', c) FROM t WHERE a % 200 = 199");
+	expect_stat(db,"wide","cache_hits",1);
+#ifdef STATEMENT_VTAB_SHARED_BYTES
+	if(stat_value(db,"wide","shared_bytes") > STATEMENT_VTAB_SHARED_BYTES)
+		fail("shared_bytes","over","at most STATEMENT_VTAB_SHARED_BYTES");
+#endif
+	// results that aren't deterministic no longer hold once either connection writes to the file, whereas those
+	// of deterministic tables are kept
+	const char* sql = "SELECT a, w FROM wide(7)";
+	const char* inline_sql = "SELECT a, replace(hex(zeroblob(50)), '0', c) FROM t WHERE a % 200 = 7";
+	expect_same(db,"SELECT a, c FROM f(6)","SELECT a, c FROM t WHERE b = 6");
+	expect_same(other,sql,inline_sql);
+	exec(db,"UPDATE t SET c = 'd' WHERE a = 207;");
+	expect_same(other,sql,inline_sql);
+	expect_same(db,sql,inline_sql);
+	exec(other,"UPDATE t SET c = 'e' WHERE a = 407;");
+	expect_same(db,sql,inline_sql);
+	expect_same(other,sql,inline_sql);
+	sqlite3_int64 hits = stat_value(db,"wide","cache_hits");
+	expect_same(db,sql,inline_sql);
+	if(stat_value(db,"wide","cache_hits") != hits+1)
+		fail("cache_hits of wide","a miss on the unchanged file","a hit");
+	hits = stat_value(other,"f","cache_hits");
+	expect_same(other,"SELECT a, c FROM f(6)","SELECT a, c FROM t WHERE b = 6");
+	if(stat_value(other,"f","cache_hits") != hits+1)
+		fail("cache_hits of f","a miss","a hit");
+	sqlite3_close(other);
+	sqlite3_close(db);
+}
+
+// counts the rows a statement looks at, returning its argument
+static void counted(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+	(void)argc;
+	(*(int*)sqlite3_user_data(ctx))++;
+	sqlite3_result_value(ctx,argv[0]);
+}
+
+// a materialized table kept up to date with the writes of its connection returns what running it again in full would
+static void test_incremental(void) {
+#if SQLITE_VERSION_NUMBER >= 3039000
+	static const char* const writes[] = {
+		"INSERT INTO t VALUES(1001, 35, 'new'), (1002, 3, 'out')",
+		"UPDATE t SET b = 36 WHERE a = 5",
+		"UPDATE t SET b = 1 WHERE a = 31",
+		"UPDATE t SET c = 'changed' WHERE b = 33",
+		"UPDATE t SET a = 2000 WHERE a = 32",
+		"DELETE FROM t WHERE a % 7 = 0",
+		"INSERT OR REPLACE INTO t VALUES(33, 2, 'replaced')",
+		"BEGIN; INSERT INTO t VALUES(3000, 40, 'undone'); DELETE FROM t WHERE a = 34; ROLLBACK",
+		"BEGIN; SAVEPOINT s; UPDATE t SET b = 50 WHERE a < 20; ROLLBACK TO s; UPDATE t SET b = 51 WHERE a = 1; COMMIT",
+		"DELETE FROM t",
+	};
+	const char* sql = "SELECT a, b, c FROM m ORDER BY a";
+	const char* full_sql = "SELECT a, b, c FROM t WHERE b > 30 ORDER BY a";
+	int calls = 0;
+	sqlite3* db = test_open(test_db);
+	sqlite3_create_function(db,"counted",1,SQLITE_UTF8,&calls,counted,NULL,NULL);
+	exec(db,rows_setup);
+	exec(db,"CREATE VIRTUAL TABLE m USING statement((SELECT a, b, c FROM t WHERE counted(b) > 30), materialize=incremental);");
+	expect_same(db,sql,full_sql);
+	for(size_t i = 0; i < sizeof(writes)/sizeof(*writes); i++) {
+		exec(db,writes[i]);
+		calls = 0;
+		expect_same(db,sql,full_sql);
+		// once the statement ran, the connection's own writes are followed without running it in full again,
+		// which would look at every row
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+		if(calls > 200)
+			fail(writes[i],"ran in full","followed incrementally");
+#endif
+	}
+	// while the writes of others have it run again
+	exec(db,"INSERT INTO t SELECT a+10000, b+31, c FROM (SELECT 1 AS a, 0 AS b, 'x' AS c UNION ALL SELECT 2, 1, 'y')");
+	sqlite3* other = test_open(test_db);
+	exec(other,"INSERT INTO t VALUES(20000, 99, 'other'); UPDATE t SET b = 0 WHERE a = 10001");
+	expect_same(db,sql,full_sql);
+	sqlite3_close(other);
+	sqlite3_close(db);
+#endif
+}
+
+// runs spread over reader threads come out in the order they would running serially, which is how the same
+// statement without the option is run. without snapshot support in sqlite the option does nothing, which holds as well
+static void test_parallel(void) {
+#if SQLITE_VERSION_NUMBER >= 3038000
+	static const char* const queries[][2] = {
+		{"SELECT k, a, c FROM par WHERE k IN (30, 2, 17, 5, 36, 0, 11)","SELECT k, a, c FROM ser WHERE k IN (30, 2, 17, 5, 36, 0, 11)"},
+		{"SELECT k, a FROM par WHERE k IN (SELECT b FROM t WHERE a < 60) AND a % 3 = 0",
+			"SELECT k, a FROM ser WHERE k IN (SELECT b FROM t WHERE a < 60) AND a % 3 = 0"},
+		{"SELECT o.b, p.a FROM t AS o, par AS p WHERE o.a < 5 AND p.k IN (o.b, o.b+1)",
+			"SELECT o.b, p.a FROM t AS o, ser AS p WHERE o.a < 5 AND p.k IN (o.b, o.b+1)"},
+		{"SELECT ordinal, a FROM par_bulk('[3, 1, 4, 1, 5, 9, 2, 6]')","SELECT ordinal, a FROM ser_bulk('[3, 1, 4, 1, 5, 9, 2, 6]')"},
+		{"SELECT k, count(*), sum(a) FROM par WHERE k IN (1, 2, 3, 4, 5, 6, 7, 8) GROUP BY k",
+			"SELECT b, count(*), sum(a) FROM t WHERE b IN (1, 2, 3, 4, 5, 6, 7, 8) GROUP BY b"},
+	};
+	sqlite3* db = test_open(test_db);
+	exec(db,"PRAGMA journal_mode = WAL;");
+	exec(db,rows_setup);
+	exec(db,
+		"CREATE VIRTUAL TABLE par USING statement((SELECT a, c FROM t WHERE b = :k ORDER BY c DESC, a), parallel=4);"
+		"CREATE VIRTUAL TABLE ser USING statement((SELECT a, c FROM t WHERE b = :k ORDER BY c DESC, a));"
+		"CREATE VIRTUAL TABLE par_bulk USING statement((SELECT a FROM t WHERE b = :k AND a < 200), bulk, parallel=3);"
+		"CREATE VIRTUAL TABLE ser_bulk USING statement((SELECT a FROM t WHERE b = :k AND a < 200), bulk);");
+	// in a read transaction as the workers need, then in autocommit mode and after a write, which run serially
+	for(int mode = 0; mode < 3; mode++) {
+		if(mode != 1)
+			exec(db,"BEGIN;");
+		if(mode == 2)
+			exec(db,"UPDATE t SET c = 'w' WHERE a % 11 = 0;");
+		for(size_t i = 0; i < sizeof(queries)/sizeof(*queries); i++)
+			expect_same(db,queries[i][0],queries[i][1]);
+		if(mode != 1)
+			exec(db,"COMMIT;");
+	}
+#if defined(SQLITE_ENABLE_SNAPSHOT) && SQLITE_VERSION_NUMBER >= 3039000 && !defined(_WIN32)
+	// seven values over four workers have every scan of par run on their connections, stepping none of its own,
+	// with the rows still in the order of the serial table
+	exec(db,"BEGIN; SELECT statement_vtab_stats_reset();");
+	expect_same(db,queries[0][0],queries[0][1]);
+	expect_stat(db,"par","vm_steps",0);
+	expect_stat(db,"ser","vm_steps",1);
+	expect_same(db,queries[3][0],queries[3][1]);
+	expect_stat(db,"par_bulk","vm_steps",0);
+	exec(db,"COMMIT;");
+#endif
+	sqlite3_close(db);
+#endif
+}
+
+static const struct {
+	const char* name;
+	void (*run)(void);
+} tests[] = {
+	{"budget without the extension's progress handler",test_budget_unset},
+	{"budget with the extension's progress handler",test_budget_set},
+	{"schema changes of the tables a statement reads",test_schema_changes},
+	{"schema changes with the registry option",test_registry_schema_changes},
+	{"cache_bytes with writes",test_cache_writes},
+	{"function option",test_function},
+	{"inline with numbered and named parameters",test_inline_params},
+	{"cache shared between connections",test_shared_cache},
+	{"materialize=incremental",test_incremental},
+	{"parallel output order",test_parallel},
+};
+
+int main(int argc, char** argv) {
+	int num_run = 0;
+	const char* slash = strrchr(argv[0],'/');
+	if(!(test_db = sqlite3_mprintf("%.*stest.db",slash ? (int)(slash-argv[0])+1 : 0,argv[0]))) {
+		printf("FAIL out of memory\n");
+		return 1;
+	}
+	for(size_t i = 0; i < sizeof(tests)/sizeof(*tests); i++) {
+		if(argc > 1 && !strstr(tests[i].name,argv[1]))
+			continue;
+		int failed = failures;
+		test_name = tests[i].name;
+		test_db_remove();
+		tests[i].run();
+		test_db_remove();
+		printf("%s %s\n",failures > failed ? "FAIL" : "ok  ",test_name);
+		num_run++;
+	}
+	printf("sqlite %s, %d tests, %d failures\n",sqlite3_libversion(),num_run,failures);
+	sqlite3_free(test_db);
+	return failures ? 1 : 0;
+}